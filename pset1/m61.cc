@@ -1,271 +1,2505 @@
 #include "m61.hh"
+#include "m61trace.hh"
 #include <cstdlib>
 #include <cstddef>
 #include <cstring>
 #include <cstdio>
 #include <cinttypes>
 #include <cassert>
+#include <cerrno>
+#include <cstdarg>
+#include <climits>
 #include <sys/mman.h>
-#include <map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <atomic>
+#include <mutex>
 
 
+// The heap is a set of mmapped arenas (`m61_memory_buffer`s). Each arena
+// is carved into blocks from the bottom up; `pos` is the arena's bump
+// frontier. The first arena is 8 MiB; when no arena has room, a new one
+// at least twice as big as the largest so far is mapped, so a process can
+// grow to any size with few arenas. Arenas other than the first are
+// unmapped as soon as all their blocks are freed.
+//
+// Arena descriptors live in a fixed table so that `m61_free` can check
+// which arena a pointer belongs to without taking `heap_lock`: a slot's
+// `size` is set before its `buffer` is published, and `buffer` is
+// cleared before the arena is unmapped.
+//
+// If the `huge_pages` option is set when an arena is created, the arena
+// is aligned to 2 MiB and the kernel is asked to back it with transparent
+// huge pages. If it cannot, the arena is used with ordinary pages.
+
 struct m61_memory_buffer {
-    char* buffer;
+    std::atomic<char*> buffer{nullptr};     // nullptr if slot is unused
+    std::atomic<size_t> size{0};
     size_t pos = 0;
-    size_t size = 8 << 20; /* 8 MiB */
+    size_t dirty_end = 0;                   // memory above this is untouched
+    bool huge = false;                      // MADV_HUGEPAGE accepted
+};
+
+static constexpr size_t M61_MAX_BUFFERS = 64;
+static constexpr size_t M61_FIRST_BUFFER_SIZE = 8 << 20;    /* 8 MiB */
+static constexpr size_t M61_MAX_BUFFER_GROWTH = 1UL << 30;  /* 1 GiB */
+static constexpr size_t M61_HUGE_PAGE_SIZE = 2 << 20;       /* 2 MiB */
+
+static m61_memory_buffer buffers[M61_MAX_BUFFERS];
+static std::atomic<size_t> nbuffers{0};     // slots ever used
+static std::atomic<bool> huge_pages{false};
+
+// `heap_lock` protects the arenas' frontiers, the free bins, and every header
+// that is not owned by a single thread. Per-thread state (caches and
+// counters) lives in `m61_tcache`, below.
+static std::mutex heap_lock;
+
+// Lowest and highest addresses ever handed out. Only changed while holding
+// `heap_lock`, but read without it by `m61_free`.
+static std::atomic<uintptr_t> heap_min{UINTPTR_MAX};
+static std::atomic<uintptr_t> heap_max{0};
+
+// m61_counter
+//    A statistics counter that only its owning thread (or the holder of
+//    its lock) writes, and that any thread may read. Updates are plain
+//    loads and stores, not atomic read-modify-writes, so counting costs
+//    no more than in a single-threaded allocator. Counters may go
+//    "negative" (wrap) when a block is freed by a different thread than
+//    the one that allocated it; the sums in `m61_get_statistics` come out
+//    right regardless.
+
+struct m61_counter {
+    std::atomic<unsigned long long> value{0};
+
+    void add(unsigned long long delta) {
+        value.store(value.load(std::memory_order_relaxed) + delta,
+                    std::memory_order_relaxed);
+    }
+    void set(unsigned long long v) {
+        value.store(v, std::memory_order_relaxed);
+    }
+    unsigned long long get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+};
+
+// Free-space accounting for `m61_get_heap_info`, updated under
+// `heap_lock` as blocks enter and leave the bins and fast bins and as
+// arena frontiers move, so that it can be read without the lock.
+
+struct m61_heap_counters {
+    m61_counter free_blocks;            // blocks in the bins
+    m61_counter free_bytes;
+    m61_counter largest_free;           // largest block in the bins
+    m61_counter tail_bytes;             // bytes above arena frontiers
+    m61_counter parked_blocks;          // blocks in fast bins
+    m61_counter parked_bytes;
+};
+
+static m61_heap_counters heap_counters;
+
+// m61_note_extent(first, last)
+//    Widen [heap_min, heap_max] to include [first, last]. The caller must
+//    hold `heap_lock`.
+
+static void m61_note_extent(uintptr_t first, uintptr_t last) {
+    if (first < heap_min.load(std::memory_order_relaxed)) {
+        heap_min.store(first, std::memory_order_relaxed);
+    }
+    if (last > heap_max.load(std::memory_order_relaxed)) {
+        heap_max.store(last, std::memory_order_relaxed);
+    }
+}
+
+// Every block starts with an `m61_header` and is a multiple of 16 bytes,
+// so every returned pointer is 16-byte aligned. The header records the
+// block's size, the requested size, and the allocation site; the low bits
+// of `block_size` say whether this block and the block before it are in
+// use. A free block also stores its size in its last 8 bytes (a boundary
+// tag), so `m61_free` can find the previous block when that block is free.
+// Free blocks reuse the `size`/`file` words as free-list or tree links.
+//
+//     allocated: [header | user data (size) | canary (8) | padding]
+//     free:      [header (links) | ...              | block_size (8)]
+
+struct m61_header {
+    size_t block_size;              // size of block | M61_INUSE | M61_PREV_INUSE
+    union {
+        struct {
+            size_t size;            // requested size
+            const char* file;       // allocation site
+        };
+        m61_header* link[2];        // free list prev/next or tree left/right
+    };
+    int line;                       // allocation site
+    uint32_t magic;                 // see m61_magic()
+};
+
+static constexpr size_t M61_ALIGN = 16;
+static constexpr size_t M61_HEADER = sizeof(m61_header);
+static constexpr size_t M61_MIN_BLOCK = 48;
+static constexpr size_t M61_INUSE = 1;
+static constexpr size_t M61_PREV_INUSE = 2;
+static constexpr size_t M61_MMAPPED = 4;       // block has its own mapping
+static constexpr size_t M61_ZEROED = 8;        // see below
+static constexpr size_t M61_FLAGS = M61_ALIGN - 1;
+static constexpr size_t M61_PAGE_SIZE = 4096;
+
+static_assert(M61_HEADER % M61_ALIGN == 0, "header preserves alignment");
+
+
+// m61_magic(h, inuse)
+//    Return the check value for a header at address `h`. The value depends
+//    on the header's own address, so a header-shaped copy of user data, or
+//    an arbitrary pointer into a block, does not look like a real block.
+//    A block's header keeps its "free" value after the block is coalesced
+//    into a neighbor, which lets `m61_free` report double frees.
+
+static uint32_t m61_magic(const m61_header* h, bool inuse) {
+    uint32_t x = (uint32_t) (((uintptr_t) h >> 4) * 0x9E3779B1U);
+    return x ^ (inuse ? 0x61A110C8U : 0x61F4EED1U);
+}
+
+// m61_chunk_magic(h)
+//    Return the check value for an in-use block that holds an arena's
+//    objects rather than a single allocation.
+
+static uint32_t m61_chunk_magic(const m61_header* h) {
+    return m61_magic(h, true) ^ 0x0C4A1A7CU;
+}
+
+// A block's M61_PREV_INUSE bit changes, under `heap_lock`, when its
+// neighbor is freed or reused, while the block's owner may be reading its
+// size, or setting M61_ZEROED, without the lock. So `block_size` is read
+// and updated with relaxed atomic accesses.
+//
+// M61_ZEROED says that every byte after the header is zero, except for
+// the last 8 bytes, which may hold a boundary tag. (User data and its
+// canary never reach a block's last 8 bytes.) It is set on blocks carved
+// from never-used arena memory or fresh mappings, and on blocks scrubbed
+// when freed, and it lets `m61_calloc` skip clearing them. It is
+// meaningless on an in-use block once the block's owner has written to
+// it; `m61_free` recomputes it.
+
+static size_t m61_flags_of(const m61_header* h) {
+    return __atomic_load_n(&h->block_size, __ATOMIC_RELAXED) & M61_FLAGS;
+}
+
+static size_t m61_size_of(const m61_header* h) {
+    return __atomic_load_n(&h->block_size, __ATOMIC_RELAXED) & ~M61_FLAGS;
+}
+
+static void m61_set_flag(m61_header* h, size_t flag, bool on) {
+    if (on) {
+        __atomic_fetch_or(&h->block_size, flag, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_and(&h->block_size, ~flag, __ATOMIC_RELAXED);
+    }
+}
+
+static void m61_set_prev_inuse(m61_header* h, bool inuse) {
+    m61_set_flag(h, M61_PREV_INUSE, inuse);
+}
+
+static void m61_set_size(m61_header* h, size_t size) {
+    size_t flags = __atomic_load_n(&h->block_size, __ATOMIC_RELAXED) & M61_FLAGS;
+    __atomic_store_n(&h->block_size, size | flags, __ATOMIC_RELAXED);
+}
+
+static m61_header* m61_header_of(void* ptr) {
+    return reinterpret_cast<m61_header*>((char*) ptr - M61_HEADER);
+}
+
+static char* m61_payload(m61_header* h) {
+    return reinterpret_cast<char*>(h) + M61_HEADER;
+}
+
+static m61_header* m61_next_block(m61_header* h) {
+    return reinterpret_cast<m61_header*>((char*) h + m61_size_of(h));
+}
+
+static char* m61_frontier(m61_memory_buffer* buf) {
+    return buf->buffer.load(std::memory_order_relaxed) + buf->pos;
+}
+
+// m61_buffer_of(ptr)
+//    Return the arena containing `ptr`, or nullptr if there is none. Safe
+//    to call without `heap_lock`.
+
+static m61_memory_buffer* m61_buffer_of(const void* ptr) {
+    size_t n = nbuffers.load(std::memory_order_acquire);
+    for (size_t i = 0; i != n; ++i) {
+        m61_memory_buffer& buf = buffers[i];
+        char* base = buf.buffer.load(std::memory_order_acquire);
+        if (base
+            && (const char*) ptr >= base
+            && (uintptr_t) ptr - (uintptr_t) base < buf.size.load(std::memory_order_relaxed)) {
+            return &buf;
+        }
+    }
+    return nullptr;
+}
+
+// m61_buffer_create(min_size)
+//    Map a new arena that can hold at least `min_size` bytes and return it,
+//    or return nullptr on failure. The caller must hold `heap_lock`.
+
+static m61_memory_buffer* m61_buffer_create(size_t min_size) {
+    size_t largest = 0;
+    m61_memory_buffer* slot = nullptr;
+    size_t n = nbuffers.load(std::memory_order_relaxed);
+    for (m61_memory_buffer& buf : buffers) {
+        if (buf.buffer.load(std::memory_order_relaxed)) {
+            size_t size = buf.size.load(std::memory_order_relaxed);
+            largest = size > largest ? size : largest;
+        } else if (!slot) {
+            slot = &buf;
+        }
+    }
+    if (!slot) {
+        return nullptr;
+    }
+
+    // Grow geometrically, but never by more than M61_MAX_BUFFER_GROWTH
+    // more than the request needs
+    size_t size = largest ? largest * 2 : M61_FIRST_BUFFER_SIZE;
+    if (size > M61_MAX_BUFFER_GROWTH) {
+        size = M61_MAX_BUFFER_GROWTH;
+    }
+    if (size < min_size) {
+        size = (min_size + M61_FIRST_BUFFER_SIZE - 1) & ~(M61_FIRST_BUFFER_SIZE - 1);
+    }
+
+    bool huge = huge_pages.load(std::memory_order_relaxed);
+    size_t slack = huge ? M61_HUGE_PAGE_SIZE : 0;
+    void* buf = mmap(nullptr,    // Place the buffer at a random address
+        size + slack,
+        PROT_READ | PROT_WRITE,  // We want to read and write the buffer
+        MAP_ANON | MAP_PRIVATE, -1, 0);
+                                 // We want memory freshly allocated by the OS
+    if (buf == MAP_FAILED) {
+        return nullptr;
+    }
+    if (huge) {
+        // Trim the mapping to a 2 MiB-aligned range
+        char* start = (char*) (((uintptr_t) buf + M61_HUGE_PAGE_SIZE - 1)
+                               & ~(uintptr_t) (M61_HUGE_PAGE_SIZE - 1));
+        if (start != (char*) buf) {
+            munmap(buf, start - (char*) buf);
+        }
+        if (start + size != (char*) buf + size + slack) {
+            munmap(start + size, (char*) buf + size + slack - (start + size));
+        }
+        buf = start;
+#ifdef MADV_HUGEPAGE
+        huge = madvise(buf, size, MADV_HUGEPAGE) == 0;
+#else
+        huge = false;
+#endif
+    }
+    slot->pos = 0;
+    slot->dirty_end = 0;
+    heap_counters.tail_bytes.add(size);
+    slot->huge = huge;
+    slot->size.store(size, std::memory_order_relaxed);
+    slot->buffer.store((char*) buf, std::memory_order_release);
+    if (size_t(slot - buffers) == n) {
+        nbuffers.store(n + 1, std::memory_order_release);
+    }
+    return slot;
+}
+
+// Requests bigger than this fail without trying to map memory (and
+// without overflowing size computations).
+static constexpr size_t M61_MAX_SIZE = PTRDIFF_MAX / 2;
+
+static size_t m61_block_size(size_t sz) {
+    size_t total_size = (M61_HEADER + sz + 8 + M61_ALIGN - 1) & ~(M61_ALIGN - 1);
+    return total_size < M61_MIN_BLOCK ? M61_MIN_BLOCK : total_size;
+}
+
+
+// Free blocks smaller than `M61_SMALL_LIMIT` bytes live on exact-size free
+// lists, one per 16-byte size class; a bitmap records which lists are
+// nonempty. Larger free blocks live in a best-fit tree (a treap ordered by
+// size, then address). The list and tree links are stored in the free
+// block's header.
+static constexpr size_t M61_SMALL_LIMIT = 1024;
+static constexpr size_t M61_NSMALLBINS = M61_SMALL_LIMIT / M61_ALIGN;
+
+static m61_header* small_bins[M61_NSMALLBINS];
+static uint64_t small_binmap;
+static m61_header* large_tree;
+
+static_assert(M61_NSMALLBINS <= 64, "small_binmap has one bit per bin");
+
+
+// Treap helpers. A node's priority is a hash of its address, so the tree
+// stays balanced in expectation without storing anything extra.
+
+static uint64_t m61_tree_priority(const m61_header* n) {
+    return (uintptr_t) n * 0x9E3779B97F4A7C15ULL;
+}
+
+static bool m61_tree_less(const m61_header* a, const m61_header* b) {
+    return m61_size_of(a) < m61_size_of(b)
+        || (m61_size_of(a) == m61_size_of(b) && a < b);
+}
+
+static m61_header* m61_tree_insert(m61_header* root, m61_header* n) {
+    if (!root) {
+        n->link[0] = n->link[1] = nullptr;
+        return n;
+    }
+    int dir = m61_tree_less(root, n);
+    root->link[dir] = m61_tree_insert(root->link[dir], n);
+    m61_header* child = root->link[dir];
+    if (m61_tree_priority(child) > m61_tree_priority(root)) {
+        root->link[dir] = child->link[!dir];
+        child->link[!dir] = root;
+        return child;
+    }
+    return root;
+}
+
+static m61_header* m61_tree_join(m61_header* a, m61_header* b) {
+    // every node in `a` is less than every node in `b`
+    if (!a || !b) {
+        return a ? a : b;
+    }
+    if (m61_tree_priority(a) > m61_tree_priority(b)) {
+        a->link[1] = m61_tree_join(a->link[1], b);
+        return a;
+    } else {
+        b->link[0] = m61_tree_join(a, b->link[0]);
+        return b;
+    }
+}
+
+static m61_header* m61_tree_remove(m61_header* root, m61_header* n) {
+    if (root == n) {
+        return m61_tree_join(n->link[0], n->link[1]);
+    }
+    int dir = m61_tree_less(root, n);
+    root->link[dir] = m61_tree_remove(root->link[dir], n);
+    return root;
+}
+
+// m61_bin_insert(h), m61_bin_remove(h)
+//    Add or remove the free block `h` to or from its size class list or
+//    the large tree.
+
+static void m61_bin_insert(m61_header* h) {
+    size_t size = m61_size_of(h);
+    heap_counters.free_blocks.add(1);
+    heap_counters.free_bytes.add(size);
+    if (size > heap_counters.largest_free.get()) {
+        heap_counters.largest_free.set(size);
+    }
+    if (size < M61_SMALL_LIMIT) {
+        size_t bin = size / M61_ALIGN;
+        h->link[0] = nullptr;
+        h->link[1] = small_bins[bin];
+        if (small_bins[bin]) {
+            small_bins[bin]->link[0] = h;
+        }
+        small_bins[bin] = h;
+        small_binmap |= uint64_t(1) << bin;
+    } else {
+        large_tree = m61_tree_insert(large_tree, h);
+    }
+}
+
+static void m61_bin_remove(m61_header* h) {
+    size_t size = m61_size_of(h);
+    if (size < M61_SMALL_LIMIT) {
+        size_t bin = size / M61_ALIGN;
+        if (h->link[0]) {
+            h->link[0]->link[1] = h->link[1];
+        } else {
+            small_bins[bin] = h->link[1];
+        }
+        if (h->link[1]) {
+            h->link[1]->link[0] = h->link[0];
+        }
+        if (!small_bins[bin]) {
+            small_binmap &= ~(uint64_t(1) << bin);
+        }
+    } else {
+        large_tree = m61_tree_remove(large_tree, h);
+    }
+
+    heap_counters.free_blocks.add(-1);
+    heap_counters.free_bytes.add(-size);
+    if (size == heap_counters.largest_free.get()) {
+        // find the new largest: the tree's rightmost node, or else the
+        // biggest nonempty size class
+        size_t largest = 0;
+        if (m61_header* t = large_tree) {
+            while (t->link[1]) {
+                t = t->link[1];
+            }
+            largest = m61_size_of(t);
+        } else if (small_binmap) {
+            largest = (63 - __builtin_clzll(small_binmap)) * M61_ALIGN;
+        }
+        heap_counters.largest_free.set(largest);
+    }
+}
+
+// m61_make_free(h, size, zeroed)
+//    Turn `h` into a free block of `size` bytes whose previous block is in
+//    use: write its header and boundary tag, tell the next block, and bin
+//    it. `zeroed` says whether the block's contents are zero. Free blocks
+//    never touch an arena's frontier, so the next block always exists.
+
+static void m61_make_free(m61_header* h, size_t size, bool zeroed) {
+    h->block_size = size | M61_PREV_INUSE | (zeroed ? M61_ZEROED : 0);
+    h->magic = m61_magic(h, false);
+    memcpy((char*) h + size - sizeof(size_t), &size, sizeof(size_t));
+    m61_set_prev_inuse(m61_next_block(h), false);
+    m61_bin_insert(h);
+}
+
+// m61_find_free_space(total_size)
+//    Return an in-use block of at least `total_size` bytes carved from the
+//    bins, or nullptr if none is big enough. Small sizes take the first
+//    nonempty size class at or above `total_size` (O(1) via
+//    `small_binmap`); everything else takes the best fit from the large
+//    tree (O(log n)). The unused tail of the block, if big enough, is
+//    returned to the bins.
+
+static m61_header* m61_find_free_space(size_t total_size) {
+    m61_header* h = nullptr;
+    if (total_size < M61_SMALL_LIMIT) {
+        uint64_t mask = small_binmap & (~uint64_t(0) << (total_size / M61_ALIGN));
+        if (mask) {
+            h = small_bins[__builtin_ctzll(mask)];
+        }
+    }
+    if (!h) {
+        for (m61_header* t = large_tree; t; ) {
+            if (m61_size_of(t) >= total_size) {
+                h = t;
+                t = t->link[0];
+            } else {
+                t = t->link[1];
+            }
+        }
+    }
+    if (!h) {
+        return nullptr;
+    }
+
+    m61_bin_remove(h);
+    size_t size = m61_size_of(h);
+    size_t zeroed = m61_flags_of(h) & M61_ZEROED;
+    if (size - total_size >= M61_MIN_BLOCK) {
+        m61_make_free(reinterpret_cast<m61_header*>((char*) h + total_size),
+                      size - total_size, zeroed);
+        size = total_size;
+    } else {
+        m61_set_prev_inuse(m61_next_block(h), true);
+    }
+    h->block_size = size | M61_INUSE | M61_PREV_INUSE | zeroed;
+    return h;
+}
+
+// m61_containing_block(ptr)
+//    Return the active block whose user data contains `ptr`, or nullptr.
+//    Walks every block in the arena, so it is only used for reporting.
+//    Blocks parked in a thread cache are in use as far as the buffer is
+//    concerned, so this checks the header's magic rather than M61_INUSE.
+//    The caller must hold `heap_lock`.
+
+static m61_header* m61_containing_block(void* ptr) {
+    m61_memory_buffer* buf = m61_buffer_of(ptr);
+    if (!buf) {
+        return nullptr;
+    }
+    for (m61_header* h = reinterpret_cast<m61_header*>(buf->buffer.load(std::memory_order_relaxed));
+         (char*) h < m61_frontier(buf);
+         h = m61_next_block(h)) {
+        if (h->magic == m61_magic(h, true)
+            && ptr >= m61_payload(h)
+            && ptr < m61_payload(h) + h->size) {
+            return h;
+        }
+    }
+    return nullptr;
+}
+
+
+// Free memory is handed back to the OS with madvise(MADV_DONTNEED) once a
+// free range reaches `trim_threshold` bytes: the whole pages inside a
+// large free block (its header and boundary tag stay), or the pages of an
+// arena's unused tail that have been written. Such pages read as zero
+// when next touched, so trimming the tail also lowers `dirty_end`.
+
+static std::atomic<size_t> trim_threshold{128 << 10};
+
+// m61_trim_block(buf, h)
+//    Release the pages inside the free block `h` of arena `buf` if it is
+//    big enough. In a huge-page arena, only whole huge pages are released,
+//    so that the rest stay huge.
+
+static void m61_trim_block(m61_memory_buffer* buf, m61_header* h) {
+    size_t size = m61_size_of(h);
+    if (size < trim_threshold.load(std::memory_order_relaxed)) {
+        return;
+    }
+    uintptr_t unit = buf->huge ? M61_HUGE_PAGE_SIZE : M61_PAGE_SIZE;
+    uintptr_t first = ((uintptr_t) m61_payload(h) + unit - 1) & ~(unit - 1);
+    uintptr_t last = ((uintptr_t) h + size - sizeof(size_t)) & ~(unit - 1);
+    if (first < last) {
+        madvise((void*) first, last - first, MADV_DONTNEED);
+    }
+}
+
+// m61_trim_frontier(buf)
+//    Release the written pages above `buf`'s frontier if there are enough.
+
+static void m61_trim_frontier(m61_memory_buffer* buf) {
+    size_t unit = buf->huge ? M61_HUGE_PAGE_SIZE : M61_PAGE_SIZE;
+    size_t first = (buf->pos + unit - 1) & ~(unit - 1);
+    size_t last = (buf->dirty_end + unit - 1) & ~(unit - 1);
+    if (first < last && last - first >= trim_threshold.load(std::memory_order_relaxed)) {
+        madvise(buf->buffer.load(std::memory_order_relaxed) + first, last - first, MADV_DONTNEED);
+        buf->dirty_end = first;
+    }
+}
+
+// m61_release(h)
+//    Return the in-use block `h` to the shared heap, coalescing it with
+//    free neighbors and with the unused tail of its arena, and trimming the
+//    result. An arena other than the first is unmapped once it is empty.
+//    The block stays M61_ZEROED if it was and is not merged: merging
+//    leaves stale headers inside the block. The caller must hold
+//    `heap_lock`.
+
+static void m61_release(m61_header* h) {
+    m61_memory_buffer* buf = m61_buffer_of(h);
+    char* base = buf->buffer.load(std::memory_order_relaxed);
+    bool zeroed = m61_flags_of(h) & M61_ZEROED;
+
+    // Coalesce free space with free space
+    // Is there a free block right after this one?
+    size_t total_size = m61_size_of(h);
+    m61_header* next = m61_next_block(h);
+    if ((char*) next != m61_frontier(buf) && !(m61_flags_of(next) & M61_INUSE)) {
+        m61_bin_remove(next);
+        total_size += m61_size_of(next);
+        zeroed = false;
+    }
+
+    // Is there a prev block to coalesce with? Its boundary tag says where
+    // it starts.
+    if (!(m61_flags_of(h) & M61_PREV_INUSE)) {
+        size_t prev_size;
+        memcpy(&prev_size, (char*) h - sizeof(size_t), sizeof(size_t));
+        h = reinterpret_cast<m61_header*>((char*) h - prev_size);
+        m61_bin_remove(h);
+        total_size += prev_size;
+        zeroed = false;
+    }
+
+    // Try to coalesce space with unused buffer memory
+    if ((char*) h + total_size != m61_frontier(buf)) {
+        m61_make_free(h, total_size, zeroed);
+        m61_trim_block(buf, h);
+        return;
+    }
+    buf->pos = (char*) h - base;
+    heap_counters.tail_bytes.add(total_size);
+    if (buf->pos == 0 && buf != &buffers[0]) {
+        heap_counters.tail_bytes.add(-buf->size.load(std::memory_order_relaxed));
+        buf->buffer.store(nullptr, std::memory_order_release);
+        munmap(base, buf->size.load(std::memory_order_relaxed));
+    } else {
+        m61_trim_frontier(buf);
+    }
+}
+
+
+// Fast bins. Small blocks returned to the shared heap by `m61_free` (when
+// a thread's cache overflows) are parked, uncoalesced, on LIFO lists of
+// exact size, and handed straight back to requests of that size. Like
+// cached blocks, parked blocks keep M61_INUSE and have free headers. A
+// list that reaches `M61_FAST_COUNT` blocks is coalesced into the bins;
+// all lists are coalesced before a large request is served, and before
+// the heap is grown. Protected by `heap_lock`.
+
+static constexpr unsigned M61_FAST_COUNT = 32;
+
+static m61_header* fast_bins[M61_NSMALLBINS];
+static unsigned fast_count[M61_NSMALLBINS];
+static size_t fast_total;                       // blocks in all lists
+
+// m61_fast_consolidate(bin)
+//    Coalesce every block in fast bin `bin` into the heap.
+
+static void m61_fast_consolidate(size_t bin) {
+    while (m61_header* h = fast_bins[bin]) {
+        fast_bins[bin] = h->link[1];
+        heap_counters.parked_blocks.add(-1);
+        heap_counters.parked_bytes.add(-m61_size_of(h));
+        m61_release(h);
+    }
+    fast_total -= fast_count[bin];
+    fast_count[bin] = 0;
+}
+
+static void m61_fast_consolidate_all() {
+    for (size_t bin = 0; fast_total != 0 && bin != M61_NSMALLBINS; ++bin) {
+        m61_fast_consolidate(bin);
+    }
+}
+
+// m61_release_fast(h)
+//    Return the in-use block `h` to the heap: park it in a fast bin if it
+//    is small, else coalesce it.
+
+static void m61_release_fast(m61_header* h) {
+    size_t size = m61_size_of(h);
+    if (size >= M61_SMALL_LIMIT) {
+        m61_release(h);
+        return;
+    }
+    size_t bin = size / M61_ALIGN;
+    if (fast_count[bin] == M61_FAST_COUNT) {
+        m61_fast_consolidate(bin);
+    }
+    h->link[1] = fast_bins[bin];
+    fast_bins[bin] = h;
+    ++fast_count[bin];
+    ++fast_total;
+    heap_counters.parked_blocks.add(1);
+    heap_counters.parked_bytes.add(size);
+}
+
+
+struct m61_thread_stats {
+    m61_counter nactive;
+    m61_counter active_size;
+    m61_counter ntotal;
+    m61_counter total_size;
+    m61_counter nfail;
+    m61_counter fail_size;
+};
+
+
+static void m61_add_thread_stats(m61_statistics& stats, const m61_thread_stats& ts) {
+    stats.nactive += ts.nactive.get();
+    stats.active_size += ts.active_size.get();
+    stats.ntotal += ts.ntotal.get();
+    stats.total_size += ts.total_size.get();
+    stats.nfail += ts.nfail.get();
+    stats.fail_size += ts.fail_size.get();
+}
+
+
+// Allocation sites. Every `file`:`line` that allocates gets an entry in
+// `sites`, an open-addressed hash table keyed by the `file` pointer and
+// line (call sites pass string literals, so pointer equality is enough).
+// Entries are claimed under `site_lock` and never removed; lookups are
+// lock-free, and counters are updated with relaxed atomics. Once the
+// table is three-quarters full, new sites are lumped into `site_overflow`,
+// and `sites_full` lets them skip `site_lock`. Each entry has a cache
+// line of its own, so busy sites do not slow each other down.
+// The table must need no static constructor: when m61 is the process's
+// malloc, other libraries allocate before this file's constructors run.
+
+struct alignas(64) m61_site {
+    std::atomic<const char*> file{nullptr};     // published after `line`
+    int line = 0;
+    std::atomic<unsigned long long> count{0};   // # allocations
+    std::atomic<unsigned long long> bytes{0};   // # bytes allocated
+    std::atomic<unsigned long long> live{0};    // # bytes in active allocations
+    std::atomic<unsigned long long> peak{0};    // max `live`
+    bool traced = false;                        // announced in the current
+                                                // trace; see `trace_lock`
+};
+
+static constexpr size_t M61_NSITES = 16384;
+
+static constinit m61_site sites[M61_NSITES];
+static constinit m61_site site_overflow;
+static std::mutex site_lock;
+static size_t nsites;                   // protected by `site_lock`
+static std::atomic<bool> sites_full{false};
+
+// m61_site_of(file, line)
+//    Return the entry for allocation site `file`:`line`, adding it if
+//    necessary.
+
+static m61_site* m61_site_of(const char* file, int line) {
+    // mix the line into every bit before taking the top ones, so the
+    // lines of one file spread over the table
+    uint64_t key = (uintptr_t) file ^ ((unsigned) line * 0xC2B2AE3D27D4EB4FULL);
+    size_t i = (key * 0x9E3779B97F4A7C15ULL) >> 50;
+    static_assert(M61_NSITES == size_t(1) << (64 - 50), "hash fills the table");
+    for (bool locked = false; ; ) {
+        for (size_t j = i; ; j = (j + 1) % M61_NSITES) {
+            const char* f = sites[j].file.load(std::memory_order_acquire);
+            if (f == file && sites[j].line == line) {
+                return &sites[j];
+            } else if (!f) {
+                break;
+            }
+        }
+        if (locked) {
+            break;
+        } else if (sites_full.load(std::memory_order_relaxed)) {
+            return &site_overflow;
+        }
+        site_lock.lock();
+        locked = true;
+    }
+
+    // Not found with `site_lock` held: claim the first empty slot
+    m61_site* s = &site_overflow;
+    if (nsites < M61_NSITES / 4 * 3) {
+        size_t j = i;
+        while (sites[j].file.load(std::memory_order_relaxed)) {
+            j = (j + 1) % M61_NSITES;
+        }
+        s = &sites[j];
+        s->line = line;
+        s->file.store(file, std::memory_order_release);
+        if (++nsites == M61_NSITES / 4 * 3) {
+            sites_full.store(true, std::memory_order_relaxed);
+        }
+    }
+    site_lock.unlock();
+    return s;
+}
+
+// m61_site_alloc(file, line, sz), m61_site_free(file, line, sz)
+//    Account for an allocation or free of `sz` bytes allocated at
+//    `file`:`line`.
+
+static void m61_site_alloc(const char* file, int line, size_t sz) {
+    m61_site* s = m61_site_of(file, line);
+    s->count.fetch_add(1, std::memory_order_relaxed);
+    s->bytes.fetch_add(sz, std::memory_order_relaxed);
+    unsigned long long live = s->live.fetch_add(sz, std::memory_order_relaxed) + sz;
+    unsigned long long peak = s->peak.load(std::memory_order_relaxed);
+    while (live > peak
+           && !s->peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+}
+
+static void m61_site_free(const char* file, int line, size_t sz) {
+    m61_site_of(file, line)->live.fetch_sub(sz, std::memory_order_relaxed);
+}
+
+
+// m61_tcache
+//    Per-thread cache of freed small blocks, one LIFO list per size class,
+//    plus that thread's statistics. `m61_malloc` and `m61_free` only take
+//    `heap_lock` on a cache miss, or when a list already holds
+//    `M61_TCACHE_COUNT` blocks. Cached blocks keep M61_INUSE, so the heap
+//    does not coalesce with them, but their headers are marked free, so
+//    double frees are still caught and the leak report skips them.
+
+static constexpr unsigned M61_TCACHE_COUNT = 8;
+
+// Under M61_SCRUB_DEFERRED, freed arena blocks wait on the thread's
+// `scrub_list` until this many bytes are pending, and are then cleared
+// together. Pending blocks are treated like cached ones.
+static constexpr size_t M61_SCRUB_BATCH = 64 << 10;
+
+static std::atomic<int> scrub_policy{M61_SCRUB_ON};
+
+// Quarantine. If the `quarantine_bytes` option is nonzero, freed arena
+// blocks are filled with M61_POISON and held, still marked in use but
+// with free headers, in a FIFO of at most that many bytes (and at most
+// M61_QUARANTINE_SLOTS blocks) before they are recycled. A block leaving
+// the quarantine must still be all poison, so writes through dangling
+// pointers are caught, and double frees of quarantined blocks are caught
+// as usual. `quarantine_lock` protects the FIFO; blocks are checked and
+// recycled without it.
+
+static constexpr size_t M61_QUARANTINE_SLOTS = 1 << 16;
+static constexpr unsigned char M61_POISON = 0xFD;
+
+static std::atomic<size_t> quarantine_limit{0};
+static std::mutex quarantine_lock;
+static m61_header* quarantine[M61_QUARANTINE_SLOTS];    // ring buffer
+static size_t quarantine_first;         // index of oldest block
+static size_t quarantine_count;         // # blocks in `quarantine`
+static size_t quarantine_size;          // # bytes in those blocks
+
+struct m61_tcache {
+    m61_header* bins[M61_NSMALLBINS];
+    unsigned count[M61_NSMALLBINS];
+    m61_header* scrub_list;     // freed blocks awaiting scrubbing
+    size_t scrub_bytes;
+    m61_thread_stats stats;
+    m61_tcache* prev;           // links in `tcache_list`
+    m61_tcache* next;
+    unsigned thread_id;         // thread number in traces
+};
+
+// Initial-exec TLS never allocates, which matters when m61 is malloc
+static thread_local m61_tcache* tcache __attribute__((tls_model("initial-exec")));
+
+// All live thread caches, and the statistics of threads that have exited.
+static std::mutex tcache_list_lock;
+static m61_tcache* tcache_list;
+static m61_thread_stats retired_stats;
+static unsigned nthreads;               // # caches ever created
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_key_once = PTHREAD_ONCE_INIT;
+
+
+// m61_tcache_flush(tc, bin, keep)
+//    Move all but `keep` blocks in `tc`'s list `bin` to the shared heap's
+//    fast bins. The caller must hold `heap_lock`.
+
+static void m61_tcache_flush(m61_tcache* tc, size_t bin, unsigned keep) {
+    while (tc->count[bin] > keep) {
+        m61_header* h = tc->bins[bin];
+        tc->bins[bin] = h->link[1];
+        --tc->count[bin];
+        m61_release_fast(h);
+    }
+}
+
+// m61_scrub_pending(tc)
+//    Clear the blocks on `tc`'s scrub list and move them into its cache.
+//    Return the blocks that do not fit in the cache, linked through
+//    `link[1]`, for the caller to release.
+
+static m61_header* m61_scrub_pending(m61_tcache* tc) {
+    m61_header* rest = nullptr;
+    while (m61_header* h = tc->scrub_list) {
+        tc->scrub_list = h->link[1];
+        memset(m61_payload(h), 0, m61_size_of(h) - M61_HEADER);
+        m61_set_flag(h, M61_ZEROED, true);
+        size_t bin = m61_size_of(h) / M61_ALIGN;
+        if (m61_size_of(h) < M61_SMALL_LIMIT && tc->count[bin] < M61_TCACHE_COUNT) {
+            h->link[1] = tc->bins[bin];
+            tc->bins[bin] = h;
+            ++tc->count[bin];
+        } else {
+            h->link[1] = rest;
+            rest = h;
+        }
+    }
+    tc->scrub_bytes = 0;
+    return rest;
+}
+
+// m61_release_list(h)
+//    Release every block on the `link[1]` list `h`. The caller must hold
+//    `heap_lock`.
+
+static void m61_release_list(m61_header* h) {
+    while (h) {
+        m61_header* next = h->link[1];
+        m61_release(h);
+        h = next;
+    }
+}
+
+// m61_tcache_flush_all(tc)
+//    Return every block in `tc`, and every block in a fast bin, to the
+//    heap, coalescing them. The caller must hold `heap_lock`.
+
+static void m61_tcache_flush_all(m61_tcache* tc) {
+    m61_release_list(m61_scrub_pending(tc));
+    for (size_t bin = 0; bin != M61_NSMALLBINS; ++bin) {
+        m61_tcache_flush(tc, bin, 0);
+    }
+    m61_fast_consolidate_all();
+}
+
+// m61_retire_thread_stats(ts)
+//    Fold an exiting thread's counters into `retired_stats`. The caller
+//    must hold `tcache_list_lock`.
+
+static void m61_retire_thread_stats(const m61_thread_stats& ts) {
+    retired_stats.nactive.add(ts.nactive.get());
+    retired_stats.active_size.add(ts.active_size.get());
+    retired_stats.ntotal.add(ts.ntotal.get());
+    retired_stats.total_size.add(ts.total_size.get());
+    retired_stats.nfail.add(ts.nfail.get());
+    retired_stats.fail_size.add(ts.fail_size.get());
+}
+
+static void m61_tcache_exit(void* arg) {
+    m61_tcache* tc = static_cast<m61_tcache*>(arg);
+    {
+        std::unique_lock<std::mutex> guard(heap_lock);
+        m61_tcache_flush_all(tc);
+    }
+    {
+        std::unique_lock<std::mutex> guard(tcache_list_lock);
+        m61_retire_thread_stats(tc->stats);
+        (tc->prev ? tc->prev->next : tcache_list) = tc->next;
+        if (tc->next) {
+            tc->next->prev = tc->prev;
+        }
+    }
+    tcache = nullptr;
+    munmap(tc, sizeof(m61_tcache));
+}
+
+// Allocation tracing. While a trace is running (see `m61_trace_start`),
+// every allocation and free is appended to `trace_buf`, which is written
+// to `trace_fd` when full. `trace_lock` protects the buffer and also puts
+// the records in a single order; it is taken before any other lock. The
+// file format is described in m61trace.hh.
+
+static constexpr size_t M61_TRACE_BUFFER = 1024;   // records
+
+static std::mutex trace_lock;
+static std::atomic<bool> tracing{false};
+static int trace_fd = -1;                       // protected by `trace_lock`
+static uint64_t trace_epoch;                    // start time, in ns
+static m61_trace_record trace_buf[M61_TRACE_BUFFER];
+static size_t trace_n;                          // # records in `trace_buf`
+
+static uint64_t m61_trace_clock() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// m61_trace_flush()
+//    Write `trace_buf` to the trace file and empty it. Records that cannot
+//    be written are dropped. The caller must hold `trace_lock`.
+
+static void m61_trace_flush() {
+    const char* p = reinterpret_cast<const char*>(trace_buf);
+    size_t n = trace_n * sizeof(m61_trace_record);
+    while (n != 0) {
+        ssize_t w = write(trace_fd, p, n);
+        if (w > 0) {
+            p += w;
+            n -= w;
+        } else if (w == 0 || errno != EINTR) {
+            break;
+        }
+    }
+    trace_n = 0;
+}
+
+// m61_trace_append()
+//    Return the next record in `trace_buf`, zeroed, flushing the buffer
+//    first if it is full. The caller must hold `trace_lock`.
+
+static m61_trace_record* m61_trace_append() {
+    if (trace_n == M61_TRACE_BUFFER) {
+        m61_trace_flush();
+    }
+    m61_trace_record* r = &trace_buf[trace_n];
+    ++trace_n;
+    memset(r, 0, sizeof(m61_trace_record));
+    return r;
+}
+
+// m61_trace_locked(tc, op, ptr, sz, arg, file, line)
+//    Record operation `op` by the thread owning `tc`, announcing site
+//    `file`:`line` first if this trace has not seen it. Does nothing if
+//    no trace is running. The caller must hold `trace_lock`.
+
+static void m61_trace_locked(m61_tcache* tc, m61_trace_op op, const void* ptr,
+                             size_t sz, uint64_t arg, const char* file, int line) {
+    if (trace_fd < 0) {
+        return;
+    }
+    m61_site* s = m61_site_of(file, line);
+    uint32_t site = s == &site_overflow ? M61_NSITES : s - sites;
+    uint64_t now = m61_trace_clock() - trace_epoch;
+    if (!s->traced) {
+        s->traced = true;
+        const char* name = s == &site_overflow || !file ? "(other)" : file;
+        size_t len = strlen(name);
+        m61_trace_record* r = m61_trace_append();
+        r->time = now;
+        r->size = len;
+        r->arg = s == &site_overflow ? 0 : line;
+        r->thread = tc->thread_id;
+        r->site = site;
+        r->op = M61_TRACE_SITE;
+        for (size_t off = 0; off < len; off += sizeof(m61_trace_record)) {
+            size_t n = len - off < sizeof(m61_trace_record) ? len - off : sizeof(m61_trace_record);
+            memcpy(m61_trace_append(), name + off, n);
+        }
+    }
+    m61_trace_record* r = m61_trace_append();
+    r->time = now;
+    r->ptr = reinterpret_cast<uintptr_t>(ptr);
+    r->size = sz;
+    r->arg = arg;
+    r->thread = tc->thread_id;
+    r->site = site;
+    r->op = op;
+}
+
+static void m61_trace(m61_tcache* tc, m61_trace_op op, const void* ptr,
+                      size_t sz, uint64_t arg, const char* file, int line) {
+    std::unique_lock<std::mutex> guard(trace_lock);
+    m61_trace_locked(tc, op, ptr, sz, arg, file, line);
+}
+
+
+// m61_fork_prepare(), m61_fork_parent(), m61_fork_child()
+//    Hold every lock across fork(), so the child does not inherit a lock
+//    held by a thread that does not exist there. The child does not
+//    continue its parent's trace.
+
+static void m61_fork_prepare() {
+    trace_lock.lock();
+    quarantine_lock.lock();
+    site_lock.lock();
+    heap_lock.lock();
+    tcache_list_lock.lock();
+}
+
+static void m61_fork_parent() {
+    tcache_list_lock.unlock();
+    heap_lock.unlock();
+    site_lock.unlock();
+    quarantine_lock.unlock();
+    trace_lock.unlock();
+}
+
+static void m61_fork_child() {
+    if (trace_fd >= 0) {
+        close(trace_fd);
+        trace_fd = -1;
+        trace_n = 0;
+        tracing.store(false, std::memory_order_relaxed);
+    }
+    m61_fork_parent();
+}
+
+static void m61_tcache_make_key() {
+    int r = pthread_key_create(&tcache_key, m61_tcache_exit);
+    assert(r == 0);
+    r = pthread_atfork(m61_fork_prepare, m61_fork_parent, m61_fork_child);
+    assert(r == 0);
+    (void) r;
+}
+
+// m61_get_tcache()
+//    Return the calling thread's cache, creating it on first use. Caches
+//    are mmapped rather than taken from the heap they serve.
+
+static m61_tcache* m61_get_tcache() {
+    if (!tcache) {
+        void* mem = mmap(nullptr, sizeof(m61_tcache), PROT_READ | PROT_WRITE,
+                         MAP_ANON | MAP_PRIVATE, -1, 0);
+        assert(mem != MAP_FAILED);
+        m61_tcache* tc = new (mem) m61_tcache;
+        {
+            std::unique_lock<std::mutex> guard(tcache_list_lock);
+            tc->thread_id = ++nthreads;
+            tc->prev = nullptr;
+            tc->next = tcache_list;
+            if (tcache_list) {
+                tcache_list->prev = tc;
+            }
+            tcache_list = tc;
+        }
+        // Publish the cache first: the pthread calls below may call
+        // malloc, which may be m61_malloc
+        tcache = tc;
+        pthread_once(&tcache_key_once, m61_tcache_make_key);
+        pthread_setspecific(tcache_key, tc);
+    }
+    return tcache;
+}
+
+
+// m61_bump_alloc(total_size)
+//    Carve an in-use block of `total_size` bytes from the frontier of some
+//    arena, or return nullptr if none has room. The caller must hold
+//    `heap_lock`.
+
+static m61_header* m61_bump_alloc(size_t total_size) {
+    size_t n = nbuffers.load(std::memory_order_relaxed);
+    for (size_t i = 0; i != n; ++i) {
+        m61_memory_buffer& buf = buffers[i];
+        char* base = buf.buffer.load(std::memory_order_relaxed);
+        if (base && total_size <= buf.size.load(std::memory_order_relaxed) - buf.pos) {
+            m61_header* h = reinterpret_cast<m61_header*>(base + buf.pos);
+            h->block_size = total_size | M61_INUSE | M61_PREV_INUSE
+                | (buf.pos >= buf.dirty_end ? M61_ZEROED : 0);
+            buf.pos += total_size;
+            heap_counters.tail_bytes.add(-total_size);
+            if (buf.pos > buf.dirty_end) {
+                buf.dirty_end = buf.pos;
+            }
+            return h;
+        }
+    }
+    return nullptr;
+}
+
+// m61_heap_alloc(total_size)
+//    Carve an in-use block of `total_size` bytes out of the shared heap, or
+//    return nullptr if there is no room. A small request first tries its
+//    fast bin; a large one coalesces the fast bins. Then free blocks are
+//    tried, then arena frontiers. Before mapping a new arena, the calling
+//    thread's cache and the fast bins are flushed, so their blocks can
+//    coalesce, and free blocks and frontiers are tried again.
+
+static m61_header* m61_heap_alloc(m61_tcache* tc, size_t total_size) {
+    std::unique_lock<std::mutex> guard(heap_lock);
+    m61_header* h = nullptr;
+    if (total_size < M61_SMALL_LIMIT) {
+        size_t bin = total_size / M61_ALIGN;
+        if ((h = fast_bins[bin])) {
+            fast_bins[bin] = h->link[1];
+            --fast_count[bin];
+            --fast_total;
+            heap_counters.parked_blocks.add(-1);
+            heap_counters.parked_bytes.add(-total_size);
+            return h;
+        }
+    } else {
+        m61_fast_consolidate_all();
+    }
+    h = m61_find_free_space(total_size);
+    if (!h) {
+        h = m61_bump_alloc(total_size);
+    }
+    if (!h) {
+        m61_tcache_flush_all(tc);
+        h = m61_find_free_space(total_size);
+        if (!h) {
+            // flushed blocks may have merged into an arena's frontier
+            h = m61_bump_alloc(total_size);
+        }
+    }
+    if (!h && m61_buffer_create(total_size)) {
+        h = m61_bump_alloc(total_size);
+    }
+    if (!h) {
+        return nullptr;
+    }
+
+    //update the max and min memory location
+    m61_note_extent((uintptr_t) m61_payload(h), (uintptr_t) m61_next_block(h) - 1);
+    return h;
+}
+
+
+// Allocations of at least `mmap_threshold` bytes bypass the arenas and
+// get a mapping of their own, which `m61_free` unmaps. The header of such
+// a block (with M61_MMAPPED set and `block_size` equal to the mapping's
+// length) is preceded by an `m61_mapping`, which links it into
+// `mapping_list` for the leak report and for checking frees, and followed
+// by the user data and the canary. Usually the `m61_mapping` starts the
+// mapping, but an over-aligned block may have a few bytes of padding in
+// front of it.
+
+struct m61_mapping {
+    m61_mapping* prev;
+    m61_mapping* next;
+    char* base;                         // start of the mapping
+};
+
+static constexpr size_t M61_MAPPING_OFFSET = (sizeof(m61_mapping) + M61_ALIGN - 1) & ~(M61_ALIGN - 1);
+
+static std::atomic<size_t> mmap_threshold{128 << 10};
+
+static m61_mapping* mapping_list;       // protected by `heap_lock`
+static size_t nmappings;                // # in `mapping_list`
+
+// Addresses of the most recently unmapped large blocks, so that freeing
+// one again is reported as a double free rather than a wild pointer.
+static constexpr unsigned M61_NUNMAPPED = 16;
+static uintptr_t recently_unmapped[M61_NUNMAPPED];
+static unsigned recently_unmapped_pos;
+
+static m61_mapping* m61_mapping_of(m61_header* h) {
+    return reinterpret_cast<m61_mapping*>((char*) h - M61_MAPPING_OFFSET);
+}
+
+static m61_header* m61_mapping_header(m61_mapping* m) {
+    return reinterpret_cast<m61_header*>((char*) m + M61_MAPPING_OFFSET);
+}
+
+// m61_large_alloc(sz, align)
+//    Map and return an in-use block for `sz` bytes of user data aligned to
+//    `align` bytes, or return nullptr on failure. An alignment above 16
+//    over-allocates by `align` bytes and gives back the whole pages on
+//    either side of the block.
+
+static m61_header* m61_large_alloc(size_t sz, size_t align = M61_ALIGN) {
+    size_t extra = align > M61_ALIGN ? align : 0;
+    size_t map_size = (M61_MAPPING_OFFSET + M61_HEADER + sz + 8 + extra + M61_PAGE_SIZE - 1)
+        & ~(M61_PAGE_SIZE - 1);
+    void* mem = mmap(nullptr, map_size, PROT_READ | PROT_WRITE,
+                     MAP_ANON | MAP_PRIVATE, -1, 0);
+    if (mem == MAP_FAILED) {
+        return nullptr;
+    }
+    char* base = static_cast<char*>(mem);
+    uintptr_t payload = ((uintptr_t) base + M61_MAPPING_OFFSET + M61_HEADER + align - 1)
+        & ~(uintptr_t) (align - 1);
+    if (extra) {
+        char* start = base + (((char*) payload - M61_MAPPING_OFFSET - M61_HEADER - base)
+                              & ~(M61_PAGE_SIZE - 1));
+        char* end = base + (((char*) payload + sz + 8 - base + M61_PAGE_SIZE - 1)
+                            & ~(M61_PAGE_SIZE - 1));
+        if (start != base) {
+            munmap(base, start - base);
+        }
+        if (end != base + map_size) {
+            munmap(end, base + map_size - end);
+        }
+        map_size = end - start;
+        base = start;
+    }
+    m61_header* h = m61_header_of((void*) payload);
+    m61_mapping* m = m61_mapping_of(h);
+    m->base = base;
+    h->block_size = map_size | M61_INUSE | M61_PREV_INUSE | M61_MMAPPED | M61_ZEROED;
+
+    std::unique_lock<std::mutex> guard(heap_lock);
+    m->prev = nullptr;
+    m->next = mapping_list;
+    if (mapping_list) {
+        mapping_list->prev = m;
+    }
+    mapping_list = m;
+    ++nmappings;
+
+    m61_note_extent((uintptr_t) m61_payload(h), (uintptr_t) base + map_size - 1);
+    return h;
+}
+
+// m61_large_free(h)
+//    Unlink and unmap the large block `h`.
+
+static void m61_large_free(m61_header* h) {
+    m61_mapping* m = m61_mapping_of(h);
+    {
+        std::unique_lock<std::mutex> guard(heap_lock);
+        (m->prev ? m->prev->next : mapping_list) = m->next;
+        if (m->next) {
+            m->next->prev = m->prev;
+        }
+        --nmappings;
+        recently_unmapped[recently_unmapped_pos] = (uintptr_t) m61_payload(h);
+        recently_unmapped_pos = (recently_unmapped_pos + 1) % M61_NUNMAPPED;
+    }
+    munmap(m->base, m61_size_of(h));
+}
+
+// m61_large_find(ptr)
+//    Return the large block whose mapping contains `ptr`, or nullptr. The
+//    caller must hold `heap_lock`.
+
+static m61_header* m61_large_find(const void* ptr) {
+    for (m61_mapping* m = mapping_list; m; m = m->next) {
+        if ((const char*) ptr >= m->base
+            && (uintptr_t) ptr - (uintptr_t) m->base < m61_size_of(m61_mapping_header(m))) {
+            return m61_mapping_header(m);
+        }
+    }
+    return nullptr;
+}
+
+
+// m61_large_resize(h, sz)
+//    Resize the large block `h` so it can hold `sz` bytes of user data,
+//    moving the mapping if necessary. Returns the (possibly moved) header,
+//    or nullptr if the mapping cannot grow, in which case `h` is
+//    unchanged.
+
+static m61_header* m61_large_resize(m61_header* h, size_t sz) {
+    size_t old_size = m61_size_of(h);
+    m61_mapping* m = m61_mapping_of(h);
+    size_t lead = (char*) m - m->base;
+    size_t map_size = (lead + M61_MAPPING_OFFSET + M61_HEADER + sz + 8 + M61_PAGE_SIZE - 1)
+        & ~(M61_PAGE_SIZE - 1);
+    if (map_size == old_size) {
+        return h;
+    }
+#ifdef __linux__
+    std::unique_lock<std::mutex> guard(heap_lock);
+    void* mem = mremap(m->base, old_size, map_size, MREMAP_MAYMOVE);
+    if (mem == MAP_FAILED) {
+        return map_size < old_size ? h : nullptr;
+    }
+    // The mapping moves by whole pages, so alignments up to a page
+    // survive; like `realloc`, this promises no more than that
+    m = reinterpret_cast<m61_mapping*>((char*) mem + lead);
+    m->base = static_cast<char*>(mem);
+    (m->prev ? m->prev->next : mapping_list) = m;
+    if (m->next) {
+        m->next->prev = m;
+    }
+    h = m61_mapping_header(m);
+    h->block_size = map_size | M61_INUSE | M61_PREV_INUSE | M61_MMAPPED;
+    h->magic = m61_magic(h, true);
+    m61_note_extent((uintptr_t) m61_payload(h), (uintptr_t) mem + map_size - 1);
+    return h;
+#else
+    return map_size < old_size ? h : nullptr;
+#endif
+}
+
+// m61_resize_in_place(h, total_size)
+//    Try to make the arena block `h` exactly `total_size` bytes long
+//    without moving it. Growing absorbs the following free block or
+//    advances the arena frontier; any excess is split off and freed.
+//    Returns false if `h` cannot grow. The caller must hold `heap_lock`.
+
+static bool m61_resize_in_place(m61_header* h, size_t total_size) {
+    m61_memory_buffer* buf = m61_buffer_of(h);
+    size_t size = m61_size_of(h);
+    if (total_size > size) {
+        size_t need = total_size - size;
+        m61_header* next = m61_next_block(h);
+        if ((char*) next == m61_frontier(buf)) {
+            if (need > buf->size.load(std::memory_order_relaxed) - buf->pos) {
+                return false;
+            }
+            buf->pos += need;
+            heap_counters.tail_bytes.add(-need);
+            if (buf->pos > buf->dirty_end) {
+                buf->dirty_end = buf->pos;
+            }
+            m61_set_size(h, total_size);
+            m61_note_extent((uintptr_t) m61_payload(h), (uintptr_t) m61_next_block(h) - 1);
+            return true;
+        }
+        if ((m61_flags_of(next) & M61_INUSE) || m61_size_of(next) < need) {
+            return false;
+        }
+        m61_bin_remove(next);
+        size += m61_size_of(next);
+        m61_set_size(h, size);
+        m61_set_prev_inuse(m61_next_block(h), true);
+    }
+    if (size - total_size >= M61_MIN_BLOCK) {
+        m61_header* tail = reinterpret_cast<m61_header*>((char*) h + total_size);
+        tail->block_size = (size - total_size) | M61_INUSE | M61_PREV_INUSE;
+        m61_set_size(h, total_size);
+        m61_release(tail);
+    }
+    return true;
+}
+
+// m61_heap_alloc_aligned(tc, sz, align)
+//    Carve an in-use block for `sz` bytes of user data whose payload is
+//    aligned to `align` bytes, which must be a power of two above 16.
+//    Takes a block with `align` bytes of slack from the heap, frees the
+//    space in front of the aligned header, and trims the tail. Returns
+//    nullptr if there is no room.
+
+static m61_header* m61_heap_alloc_aligned(m61_tcache* tc, size_t sz, size_t align) {
+    m61_header* h = m61_heap_alloc(tc, m61_block_size(sz + align + M61_MIN_BLOCK));
+    if (!h) {
+        return nullptr;
+    }
+    std::unique_lock<std::mutex> guard(heap_lock);
+    uintptr_t payload = (uintptr_t) m61_payload(h);
+    uintptr_t aligned = (payload + align - 1) & ~(uintptr_t) (align - 1);
+    if (aligned != payload && aligned - payload < M61_MIN_BLOCK) {
+        // the leading fragment must be big enough to be a free block
+        aligned += align;
+    }
+    if (aligned != payload) {
+        size_t gap = aligned - payload;
+        m61_header* nh = m61_header_of((void*) aligned);
+        nh->block_size = (m61_size_of(h) - gap) | M61_INUSE | M61_PREV_INUSE
+            | (m61_flags_of(h) & M61_ZEROED);
+        m61_set_size(h, gap);
+        m61_release(h);
+        h = nh;
+    }
+    m61_resize_in_place(h, m61_block_size(sz));
+    return h;
+}
+
+
+// m61_check_free(ptr, file, line)
+//    Return the header of the active block `ptr`. If `ptr` is not an
+//    active block, report the bug and abort.
+
+static m61_header* m61_check_free(void* ptr, const char* file, int line) {
+    // Check if the pointer falls within the heap range
+    if ((uintptr_t) ptr < heap_min.load(std::memory_order_relaxed)
+        || (uintptr_t) ptr > heap_max.load(std::memory_order_relaxed)) {
+        // If pointer is not even in the heap
+        fprintf(stderr, "MEMORY BUG: %s:%d: invalid free of pointer %p, not in heap\n", file, line, ptr);
+        abort();
+    }
+
+    // Pointers outside the arenas must be large blocks. Arenas and large
+    // blocks need not be contiguous, so a pointer may be in neither.
+    if (!m61_buffer_of((char*) ptr - M61_HEADER)) {
+        std::unique_lock<std::mutex> guard(heap_lock);
+        m61_header* h = m61_large_find(ptr);
+        if (h && ptr == m61_payload(h) && h->magic == m61_magic(h, true)) {
+            return h;
+        }
+        for (uintptr_t addr : recently_unmapped) {
+            if (addr == (uintptr_t) ptr) {
+                fprintf(stderr, "MEMORY BUG: %s:%d: invalid free of pointer %p, double free\n", file, line, ptr);
+                abort();
+            }
+        }
+        if (!h) {
+            fprintf(stderr, "MEMORY BUG: %s:%d: invalid free of pointer %p, not in heap\n", file, line, ptr);
+            abort();
+        }
+        fprintf(stderr, "MEMORY BUG: %s:%d: invalid free of pointer %p, not allocated\n", file, line, ptr);
+        if (ptr >= m61_payload(h) && ptr < m61_payload(h) + h->size) {
+            fprintf(stderr, "  %s:%d: %p is %zu bytes inside a %zu byte region allocated here\n",
+                    h->file, h->line, ptr, (size_t) ((char*) ptr - m61_payload(h)), h->size);
+        }
+        abort();
+    }
+
+    // Headers are aligned, so a misaligned pointer cannot be a block
+    m61_header* h = m61_header_of(ptr);
+    if ((uintptr_t) ptr % M61_ALIGN != 0 || h->magic != m61_magic(h, true)) {
+        // Check if the pointer was already freed (double free detection)
+        if ((uintptr_t) ptr % M61_ALIGN == 0 && h->magic == m61_magic(h, false)) {
+            fprintf(stderr, "MEMORY BUG: %s:%d: invalid free of pointer %p, double free\n", file, line, ptr);
+            abort();
+        }
+        // If it’s in the heap but not allocated
+        fprintf(stderr, "MEMORY BUG: %s:%d: invalid free of pointer %p, not allocated\n", file, line, ptr);
+        std::unique_lock<std::mutex> guard(heap_lock);
+        if (m61_header* container = m61_containing_block(ptr)) {
+            fprintf(stderr, "  %s:%d: %p is %zu bytes inside a %zu byte region allocated here\n",
+                    container->file, container->line, ptr,
+                    (size_t) ((char*) ptr - m61_payload(container)), container->size);
+        }
+        abort();
+    }
+    return h;
+}
+
+
+// m61_finish_alloc(tc, h, sz, file, line)
+//    Record the in-use block `h` as an active allocation of `sz` bytes from
+//    `file`:`line` and return its user data.
+
+static void* m61_finish_alloc(m61_tcache* tc, m61_header* h, size_t sz,
+                              const char* file, int line) {
+    h->size = sz;
+    h->file = file;
+    h->line = line;
+    h->magic = m61_magic(h, true);
+    char* ptr = m61_payload(h);
+
+    // Initialize the extra 8 bytes at the end
+    memset(ptr + sz, 0xAB, 8);
+
+    tc->stats.total_size.add(sz);
+    tc->stats.active_size.add(sz);
+    tc->stats.nactive.add(1);
+    tc->stats.ntotal.add(1);
+    m61_site_alloc(file, line, sz);
+    return ptr;
+}
+
+
+// m61_alloc(sz, file, line)
+//    Allocate as `m61_malloc`, without tracing.
+
+static void* m61_alloc(size_t sz, const char* file, int line) {
+    (void) file, (void) line;   // avoid uninitialized variable warnings
+    m61_tcache* tc = m61_get_tcache();
+
+    if (sz == 0) {
+        tc->stats.ntotal.add(1);
+        return nullptr;
+    }
+
+    // Check for overflow before proceeding
+    if (sz == 0 || sz > M61_MAX_SIZE) {
+        tc->stats.nfail.add(1);
+        tc->stats.fail_size.add(sz);
+        return nullptr;         
+    }
+
+    //see if we can claim from this thread's cache, then from the heap;
+    //big requests get their own mapping
+    size_t total_size = m61_block_size(sz);  // Header + memory + extra space for boundary detection
+    m61_header* h = nullptr;
+    size_t bin = total_size / M61_ALIGN;
+    if (sz >= mmap_threshold.load(std::memory_order_relaxed)) {
+        h = m61_large_alloc(sz);
+    } else if (total_size < M61_SMALL_LIMIT && tc->bins[bin]) {
+        h = tc->bins[bin];
+        tc->bins[bin] = h->link[1];
+        --tc->count[bin];
+    } else {
+        h = m61_heap_alloc(tc, total_size);
+    }
+    if (!h) {
+        tc->stats.nfail.add(1);
+        tc->stats.fail_size.add(sz);
+        return nullptr;
+    }
+
+    return m61_finish_alloc(tc, h, sz, file, line);
+}
+
+
+/// m61_malloc(sz, file, line)
+///    Returns a pointer to `sz` bytes of freshly-allocated dynamic memory.
+///    The memory is not initialized. If `sz == 0`, then m61_malloc may
+///    return either `nullptr` or a pointer to a unique allocation.
+///    The allocation request was made at source code location `file`:`line`.
+
+void* m61_malloc(size_t sz, const char* file, int line) {
+    void* ptr = m61_alloc(sz, file, line);
+    if (tracing.load(std::memory_order_relaxed)) {
+        m61_trace(m61_get_tcache(), M61_TRACE_MALLOC, ptr, sz, 0, file, line);
+    }
+    return ptr;
+}
+
+
+// m61_alloc_aligned(align, sz, file, line)
+//    Allocate as `m61_aligned_alloc`, without tracing.
+
+static void* m61_alloc_aligned(size_t align, size_t sz, const char* file, int line) {
+    if (align <= M61_ALIGN && align != 0 && (align & (align - 1)) == 0) {
+        return m61_alloc(sz, file, line);
+    }
+    m61_tcache* tc = m61_get_tcache();
+    if (sz == 0 && align != 0 && (align & (align - 1)) == 0) {
+        tc->stats.ntotal.add(1);
+        return nullptr;
+    }
+
+    m61_header* h = nullptr;
+    if (align != 0 && (align & (align - 1)) == 0
+        && sz <= M61_MAX_SIZE && align <= M61_MAX_SIZE - sz) {
+        if (sz + align >= mmap_threshold.load(std::memory_order_relaxed)) {
+            h = m61_large_alloc(sz, align);
+        } else {
+            h = m61_heap_alloc_aligned(tc, sz, align);
+        }
+    }
+    if (!h) {
+        tc->stats.nfail.add(1);
+        tc->stats.fail_size.add(sz);
+        return nullptr;
+    }
+
+    return m61_finish_alloc(tc, h, sz, file, line);
+}
+
+
+/// m61_aligned_alloc(align, sz, file, line)
+///    Returns a pointer to `sz` bytes of freshly-allocated dynamic memory
+///    aligned to a multiple of `align` bytes, which must be a power of two.
+///    Every allocation is at least 16-byte aligned, so smaller alignments
+///    behave like `m61_malloc`. Returns `nullptr`, counting a failed
+///    allocation, if `align` is invalid or memory is exhausted. The
+///    memory is freed with `m61_free`.
+
+void* m61_aligned_alloc(size_t align, size_t sz, const char* file, int line) {
+    void* ptr = m61_alloc_aligned(align, sz, file, line);
+    if (tracing.load(std::memory_order_relaxed)) {
+        m61_trace(m61_get_tcache(), M61_TRACE_ALIGNED, ptr, sz, align, file, line);
+    }
+    return ptr;
+}
+
+
+// m61_recycle(tc, h)
+//    Make the freed arena block `h` available again: clear it now or in a
+//    batch later, as the scrub policy says (a scrubbed block need not be
+//    cleared again by m61_calloc), then cache it or return it to the heap.
+
+static void m61_recycle(m61_tcache* tc, m61_header* h) {
+    char* ptr = m61_payload(h);
+    int scrub = scrub_policy.load(std::memory_order_relaxed);
+    if (scrub == M61_SCRUB_DEFERRED) {
+        h->link[1] = tc->scrub_list;
+        tc->scrub_list = h;
+        tc->scrub_bytes += m61_size_of(h);
+        if (tc->scrub_bytes >= M61_SCRUB_BATCH) {
+            if (m61_header* rest = m61_scrub_pending(tc)) {
+                std::unique_lock<std::mutex> guard(heap_lock);
+                m61_release_list(rest);
+            }
+        }
+        return;
+    } else if (scrub == M61_SCRUB_ON) {
+        memset(ptr, 0, m61_size_of(h) - M61_HEADER);
+    }
+    m61_set_flag(h, M61_ZEROED, scrub == M61_SCRUB_ON);
+
+    // Park small blocks in this thread's cache; when the list is full,
+    // return half of it to the heap along with this block
+    size_t bin = m61_size_of(h) / M61_ALIGN;
+    if (m61_size_of(h) < M61_SMALL_LIMIT && tc->count[bin] < M61_TCACHE_COUNT) {
+        h->link[1] = tc->bins[bin];
+        tc->bins[bin] = h;
+        ++tc->count[bin];
+        return;
+    }
+    std::unique_lock<std::mutex> guard(heap_lock);
+    if (m61_size_of(h) < M61_SMALL_LIMIT) {
+        m61_tcache_flush(tc, bin, M61_TCACHE_COUNT / 2);
+    }
+    m61_release_fast(h);
+}
+
+
+// m61_quarantine_check(h, file, line)
+//    Check that the quarantined block `h` is still all poison; the
+//    check happens during a free at `file`:`line`.
+
+static void m61_quarantine_check(m61_header* h, const char* file, int line) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(m61_payload(h));
+    size_t n = m61_size_of(h) - M61_HEADER;
+    uint64_t poison;
+    memset(&poison, M61_POISON, sizeof(poison));
+    for (size_t i = 0; i < n; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, p + i, sizeof(word));
+        if (word != poison) {
+            while (p[i] == M61_POISON) {
+                ++i;
+            }
+            fprintf(stderr, "MEMORY BUG: %s:%d: detected use after free of pointer %p\n",
+                    file, line, p);
+            fprintf(stderr, "  %s:%d: %p is %zu bytes inside a %zu byte region allocated here\n",
+                    h->file, h->line, p + i, i, h->size);
+            abort();
+        }
+    }
+}
+
+// m61_quarantine_drain(tc, limit, file, line)
+//    Check and recycle the oldest quarantined blocks until at most
+//    `limit` bytes remain, during a free at `file`:`line`.
+
+static void m61_quarantine_drain(m61_tcache* tc, size_t limit, const char* file, int line) {
+    while (true) {
+        m61_header* batch[16];
+        size_t n = 0;
+        {
+            std::unique_lock<std::mutex> guard(quarantine_lock);
+            while (n != 16 && quarantine_count != 0
+                   && (quarantine_size > limit || quarantine_count == M61_QUARANTINE_SLOTS)) {
+                m61_header* h = quarantine[quarantine_first];
+                quarantine_first = (quarantine_first + 1) % M61_QUARANTINE_SLOTS;
+                --quarantine_count;
+                quarantine_size -= m61_size_of(h);
+                batch[n] = h;
+                ++n;
+            }
+        }
+        if (n == 0) {
+            return;
+        }
+        for (size_t i = 0; i != n; ++i) {
+            m61_quarantine_check(batch[i], file, line);
+            m61_recycle(tc, batch[i]);
+        }
+    }
+}
+
+// m61_quarantine_add(tc, h, file, line)
+//    Poison the freed arena block `h` and quarantine it, evicting older
+//    blocks as needed. The free was called at `file`:`line`.
+
+static void m61_quarantine_add(m61_tcache* tc, m61_header* h, const char* file, int line) {
+    memset(m61_payload(h), M61_POISON, m61_size_of(h) - M61_HEADER);
+    m61_set_flag(h, M61_ZEROED, false);
+    size_t limit = quarantine_limit.load(std::memory_order_relaxed);
+    bool over;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(quarantine_lock);
+            if (quarantine_count != M61_QUARANTINE_SLOTS) {
+                quarantine[(quarantine_first + quarantine_count) % M61_QUARANTINE_SLOTS] = h;
+                ++quarantine_count;
+                quarantine_size += m61_size_of(h);
+                over = quarantine_size > limit;
+                break;
+            }
+        }
+        // every slot is taken: evict the oldest blocks
+        m61_quarantine_drain(tc, limit, file, line);
+    }
+    if (over) {
+        m61_quarantine_drain(tc, limit, file, line);
+    }
+}
+
+
+// m61_free_block(h, user_size, file, line)
+//    Free the active block `h`, which holds `user_size` bytes of user data.
+//    The free was called at location `file`:`line`.
+
+static void m61_free_block(m61_header* h, size_t user_size, const char* file, int line) {
+    char* ptr = m61_payload(h);
+
+    // Detect boundary write overflow before freeing
+    char* boundary_ptr = (char*)ptr + user_size;
+    for (int i = 0; i < 8; ++i) {
+        if ((unsigned char) boundary_ptr[i] != 0xAB) {  // Expect 0xAB if no boundary write occurred
+            fprintf(stderr, "MEMORY BUG: %s:%d: detected wild write during free of pointer %p\n", file, line, ptr);
+            abort();
+        }
+    }
+
+    
+    
+    m61_site_free(h->file, h->line, user_size);
+    h->magic = m61_magic(h, false);
+    m61_tcache* tc = m61_get_tcache();
+    tc->stats.nactive.add(-1);
+    tc->stats.active_size.add(-user_size);
+
+    if (m61_flags_of(h) & M61_MMAPPED) {
+        m61_large_free(h);
+    } else if (quarantine_limit.load(std::memory_order_relaxed) != 0) {
+        m61_quarantine_add(tc, h, file, line);
+    } else {
+        m61_recycle(tc, h);
+    }
+}
+
+
+/// m61_free(ptr, file, line)
+///    Frees the memory allocation pointed to by `ptr`. If `ptr == nullptr`,
+///    does nothing. Otherwise, `ptr` must point to a currently active
+///    allocation returned by `m61_malloc`. The free was called at location
+///    `file`:`line`.
+
+void m61_free(void* ptr, const char* file, int line) {
+    // avoid uninitialized variable warnings
+    (void) ptr, (void) file, (void) line;
+
+    if (ptr == nullptr ){
+        return;
+    }
 
-    m61_memory_buffer();
-    ~m61_memory_buffer();
-};
+    m61_header* h = m61_check_free(ptr, file, line);
+    if (tracing.load(std::memory_order_relaxed)) {
+        m61_trace(m61_get_tcache(), M61_TRACE_FREE, ptr, h->size, 0, file, line);
+    }
+    m61_free_block(h, h->size, file, line);
+}
 
-static m61_memory_buffer default_buffer;
 
+// If the `trust_sized_free` option is set, `m61_free_sized` takes its
+// caller's word for the pointer and size, skipping `m61_check_free`'s
+// range check, arena search, and (for mapped blocks) locked lookup. The
+// canary is still checked.
 
-m61_memory_buffer::m61_memory_buffer() {
-    void* buf = mmap(nullptr,    // Place the buffer at a random address
-        this->size,              // Buffer should be 8 MiB big
-        PROT_WRITE,              // We want to read and write the buffer
-        MAP_ANON | MAP_PRIVATE, -1, 0);
-                                 // We want memory freshly allocated by the OS
-    assert(buf != MAP_FAILED);
-    this->buffer = (char*) buf;
+static std::atomic<bool> trust_sized_free{false};
+
+/// m61_free_sized(ptr, sz, file, line)
+///    Like `m61_free`, but the caller promises that `ptr` was allocated
+///    with size `sz`. Unless the `trust_sized_free` option is set, the
+///    pointer is checked as in `m61_free` and a mismatched size is
+///    reported.
+
+void m61_free_sized(void* ptr, size_t sz, const char* file, int line) {
+    if (ptr == nullptr) {
+        return;
+    }
+    m61_header* h;
+    if (trust_sized_free.load(std::memory_order_relaxed)) {
+        h = m61_header_of(ptr);
+    } else {
+        h = m61_check_free(ptr, file, line);
+        if (h->size != sz) {
+            fprintf(stderr, "MEMORY BUG: %s:%d: invalid free of pointer %p, wrong size %zu (allocated with size %zu)\n",
+                    file, line, ptr, sz, h->size);
+            abort();
+        }
+    }
+    if (tracing.load(std::memory_order_relaxed)) {
+        m61_trace(m61_get_tcache(), M61_TRACE_FREE, ptr, sz, 0, file, line);
+    }
+    m61_free_block(h, sz, file, line);
+}
+
+
+// m61_resize(ptr, sz, file, line)
+//    Reallocate as `m61_realloc`, without tracing.
+
+static void* m61_resize(void* ptr, size_t sz, const char* file, int line) {
+    if (ptr == nullptr) {
+        return m61_alloc(sz, file, line);
+    }
+
+    m61_header* h = m61_check_free(ptr, file, line);
+    if (sz == 0) {
+        m61_free_block(h, h->size, file, line);
+        return nullptr;
+    }
+    size_t old_size = h->size;
+    char* boundary_ptr = (char*) ptr + old_size;
+    for (int i = 0; i < 8; ++i) {
+        if ((unsigned char) boundary_ptr[i] != 0xAB) {
+            fprintf(stderr, "MEMORY BUG: %s:%d: detected wild write during realloc of pointer %p\n", file, line, ptr);
+            abort();
+        }
+    }
+
+    bool resized = false;
+    if (sz > M61_MAX_SIZE) {
+        // fall through to m61_malloc, which fails
+    } else if (m61_flags_of(h) & M61_MMAPPED) {
+        if (m61_header* nh = m61_large_resize(h, sz)) {
+            h = nh;
+            resized = true;
+        }
+    } else {
+        std::unique_lock<std::mutex> guard(heap_lock);
+        resized = m61_resize_in_place(h, m61_block_size(sz));
+    }
+
+    if (!resized) {
+        void* new_ptr = m61_alloc(sz, file, line);
+        if (new_ptr) {
+            memcpy(new_ptr, ptr, old_size < sz ? old_size : sz);
+            m61_free_block(h, old_size, file, line);
+        }
+        return new_ptr;
+    }
+
+    // A resize counts as a new allocation of `sz` bytes at this site
+    m61_site_free(h->file, h->line, old_size);
+    m61_site_alloc(file, line, sz);
+    h->size = sz;
+    h->file = file;
+    h->line = line;
+    memset(m61_payload(h) + sz, 0xAB, 8);
+    m61_tcache* tc = m61_get_tcache();
+    tc->stats.active_size.add(sz - old_size);
+    tc->stats.total_size.add(sz);
+    tc->stats.ntotal.add(1);
+    return m61_payload(h);
+}
+
+
+/// m61_realloc(ptr, sz, file, line)
+///    Changes the size of the allocation pointed to by `ptr` to `sz` bytes
+///    and returns a pointer to it. The first min(old size, `sz`) bytes are
+///    preserved. The block is resized in place when possible: shrinking
+///    splits off a free tail, and growing absorbs a following free block
+///    or the arena's unused frontier; otherwise the data is copied to a
+///    new allocation. If `ptr == nullptr`, behaves like `m61_malloc(sz)`;
+///    if `sz == 0`, frees `ptr` and returns `nullptr`. Returns `nullptr`,
+///    leaving `ptr` allocated, if out of memory. The call was at location
+///    `file`:`line`.
+
+void* m61_realloc(void* ptr, size_t sz, const char* file, int line) {
+    if (!tracing.load(std::memory_order_relaxed)) {
+        return m61_resize(ptr, sz, file, line);
+    }
+    // Hold `trace_lock` throughout, so no other thread can be handed
+    // `ptr`'s memory before this call is recorded
+    m61_tcache* tc = m61_get_tcache();
+    std::unique_lock<std::mutex> guard(trace_lock);
+    void* new_ptr = m61_resize(ptr, sz, file, line);
+    m61_trace_locked(tc, M61_TRACE_REALLOC, new_ptr, sz,
+                     reinterpret_cast<uintptr_t>(ptr), file, line);
+    return new_ptr;
+}
+
+
+/// m61_usable_size(ptr)
+///    Returns the size of the active allocation `ptr`.
+
+size_t m61_usable_size(void* ptr) {
+    if (ptr == nullptr) {
+        return 0;
+    }
+    return m61_check_free(ptr, "?", 0)->size;
 }
 
-m61_memory_buffer::~m61_memory_buffer() {
-    munmap(this->buffer, this->size);
+
+// m61_alloc_zeroed(count, sz, file, line)
+//    Allocate as `m61_calloc`, without tracing.
+
+static void* m61_alloc_zeroed(size_t count, size_t sz, const char* file, int line) {
+    if (count != 0 && sz > SIZE_MAX/count){
+        //sz * count would cause an overflow
+        m61_tcache* tc = m61_get_tcache();
+        tc->stats.nfail.add(1);
+        tc->stats.fail_size.add(SIZE_MAX);
+        return nullptr;
+    }
+
+    void* ptr = m61_alloc(count * sz, file, line);
+    if (ptr && !(m61_flags_of(m61_header_of(ptr)) & M61_ZEROED)) {
+        memset(ptr, 0, count * sz);
+    }
+    return ptr;
+}
+
+
+/// m61_calloc(count, sz, file, line)
+///    Returns a pointer a fresh dynamic memory allocation big enough to
+///    hold an array of `count` elements of `sz` bytes each. Returned
+///    memory is initialized to zero. The allocation request was at
+///    location `file`:`line`. Returns `nullptr` if out of memory; may
+///    also return `nullptr` if `count == 0` or `size == 0`. Blocks known
+///    to be zero already (fresh memory, or scrubbed when freed) are not
+///    cleared again.
+
+void* m61_calloc(size_t count, size_t sz, const char* file, int line) {
+    void* ptr = m61_alloc_zeroed(count, sz, file, line);
+    if (tracing.load(std::memory_order_relaxed)) {
+        size_t total = count != 0 && sz > SIZE_MAX / count ? SIZE_MAX : count * sz;
+        m61_trace(m61_get_tcache(), M61_TRACE_CALLOC, ptr, total, count, file, line);
+    }
+    return ptr;
 }
 
-static m61_statistics gstats = {
-    .nactive = 0,
-    .active_size = 0,
-    .ntotal = 0,
-    .total_size = 0,
-    .nfail = 0,
-    .fail_size = 0,
-    .heap_min = UINTPTR_MAX,
-    .heap_max = 0
+
+// Arenas. An `m61_arena` hands out memory by bumping a pointer through a
+// list of chunks, which are blocks taken from the m61 heap (or mappings of
+// their own, if big). Objects have no headers or canaries and cannot be
+// freed one at a time; `m61_arena_reset` frees them all at once by
+// rewinding to the first chunk, keeping the chunks for reuse. Chunk
+// headers carry `m61_chunk_magic`, so `m61_free` and the leak report do
+// not mistake them for allocations. The `m61_arena` itself lives at the
+// start of its first chunk. Arena allocations count in `m61_statistics`
+// and in the site profile, under the arena's creation site.
+
+struct m61_arena_chunk {
+    m61_arena_chunk* next;
+    char* end;                  // end of usable space
 };
 
-struct AllocationInfo {
-    size_t size;
-    const char* file;
+struct m61_arena {
+    m61_arena_chunk* first;     // chunks, in allocation order
+    m61_arena_chunk* current;   // chunk being carved
+    char* pos;                  // next free byte in `current`
+    size_t next_chunk_size;
+    m61_counter nactive;        // # objects since the last reset
+    m61_counter active_size;    // # bytes in those objects
+    const char* file;           // creation site
     int line;
+    m61_arena* prev;            // links in `arena_list`
+    m61_arena* next;
 };
 
-std::map<void*, AllocationInfo> active_allocation_map;
-std::map<void*, size_t> free_allocation_map;
+static constexpr size_t M61_ARENA_CHUNK = 16 << 10;
+static constexpr size_t M61_ARENA_MAX_CHUNK = 1 << 20;
 
-void* m61_find_free_space(size_t sz) {
-    for (auto it = free_allocation_map.begin(); it != free_allocation_map.end(); it ++) {
-        if (it -> second >= sz) {
-            size_t remaining_size = it -> second - sz;
-            void* ptr = it -> first;
+static m61_arena* arena_list;           // protected by `heap_lock`
 
-            free_allocation_map.erase(it);
+// m61_arena_chunk_new(tc, size, file, line)
+//    Return a new chunk with room for `size` bytes after its
+//    `m61_arena_chunk`, or nullptr if out of memory.
 
-            if (remaining_size > 0){
-                void* remaining_size_ptr = (char*)ptr + sz;
-                free_allocation_map[remaining_size_ptr] = remaining_size;
-            }
+static m61_arena_chunk* m61_arena_chunk_new(m61_tcache* tc, size_t size,
+                                            const char* file, int line) {
+    size += sizeof(m61_arena_chunk);
+    m61_header* h;
+    if (size >= mmap_threshold.load(std::memory_order_relaxed)) {
+        h = m61_large_alloc(size);
+    } else {
+        h = m61_heap_alloc(tc, m61_block_size(size));
+    }
+    if (!h) {
+        return nullptr;
+    }
+    h->size = size;
+    h->file = file;
+    h->line = line;
+    h->magic = m61_chunk_magic(h);
+    m61_arena_chunk* c = reinterpret_cast<m61_arena_chunk*>(m61_payload(h));
+    c->next = nullptr;
+    c->end = m61_payload(h) + size;
+    return c;
+}
 
-            return ptr;
-        }
+// m61_arena_chunk_free(c)
+//    Return chunk `c` to the heap.
+
+static void m61_arena_chunk_free(m61_arena_chunk* c) {
+    m61_header* h = m61_header_of(c);
+    h->magic = m61_magic(h, false);
+    if (m61_flags_of(h) & M61_MMAPPED) {
+        m61_large_free(h);
+        return;
     }
+    m61_set_flag(h, M61_ZEROED, false);
+    std::unique_lock<std::mutex> guard(heap_lock);
+    m61_release(h);
+}
 
-    return nullptr;
+// m61_arena_start(a, c)
+//    Return the first usable byte of `a`'s chunk `c`.
+
+static char* m61_arena_start(m61_arena* a, m61_arena_chunk* c) {
+    return c == a->first ? reinterpret_cast<char*>(a + 1)
+        : reinterpret_cast<char*>(c + 1);
 }
 
-// m61_malloc(sz, file, line)
-///    Returns a pointer to `sz` bytes of freshly-allocated dynamic memory.
-///    The memory is not initialized. If `sz == 0`, then m61_malloc may
-///    return either `nullptr` or a pointer to a unique allocation.
-///    The allocation request was made at source code location `file`:`line`.
 
-void* m61_malloc(size_t sz, const char* file, int line) {
-    (void) file, (void) line;   // avoid uninitialized variable warnings
+/// m61_arena_create(file, line)
+///    Returns a new, empty arena, or `nullptr` if out of memory. The call
+///    was at location `file`:`line`.
 
-    if (sz == 0) {
-        ++gstats.ntotal;
+m61_arena* m61_arena_create(const char* file, int line) {
+    m61_tcache* tc = m61_get_tcache();
+    m61_arena_chunk* c = m61_arena_chunk_new(tc, sizeof(m61_arena) + M61_ARENA_CHUNK,
+                                             file, line);
+    if (!c) {
         return nullptr;
     }
+    m61_arena* a = new (c + 1) m61_arena;
+    a->first = a->current = c;
+    a->pos = m61_arena_start(a, c);
+    a->next_chunk_size = 2 * M61_ARENA_CHUNK;
+    a->file = file;
+    a->line = line;
 
-    // Check for overflow before proceeding
-    if (sz == 0 || sz > SIZE_MAX - 8) {  
-        ++gstats.nfail;          
-        gstats.fail_size += sz;   
-        return nullptr;         
+    std::unique_lock<std::mutex> guard(heap_lock);
+    a->prev = nullptr;
+    a->next = arena_list;
+    if (arena_list) {
+        arena_list->prev = a;
     }
+    arena_list = a;
+    return a;
+}
+
 
-    //see if we can claim from freed space
-    size_t total_size = sz + 8;  // Memory + extra space for boundary detection
-    void* ptr = m61_find_free_space(total_size);
+/// m61_arena_alloc(a, sz, align, file, line)
+///    Returns a pointer to `sz` bytes of uninitialized memory from arena
+///    `a`, aligned to `align` bytes (a power of two), or `nullptr` if out
+///    of memory. The memory stays allocated until `a` is reset or
+///    destroyed.
 
-    // Check if there is enough space left in default buffer for allocation and for overflow
-    if(!ptr){
-        if (default_buffer.pos + total_size > default_buffer.size || default_buffer.pos + total_size < default_buffer.pos) {
-            ++ gstats.nfail;
-            gstats.fail_size += sz;
-            return nullptr;
+void* m61_arena_alloc(m61_arena* a, size_t sz, size_t align, const char* file, int line) {
+    (void) file, (void) line;
+    m61_tcache* tc = m61_get_tcache();
+    if (align < M61_ALIGN) {
+        align = M61_ALIGN;
+    }
+    if (sz > M61_MAX_SIZE || (align & (align - 1)) != 0 || align > M61_MAX_SIZE - sz) {
+        tc->stats.nfail.add(1);
+        tc->stats.fail_size.add(sz);
+        return nullptr;
+    }
+
+    uintptr_t p = ((uintptr_t) a->pos + align - 1) & ~(uintptr_t) (align - 1);
+    while (p + sz > (uintptr_t) a->current->end) {
+        // Move to the next chunk, reusing chunks kept by a reset
+        if (!a->current->next) {
+            size_t size = a->next_chunk_size;
+            if (size < sz + align) {
+                size = sz + align;
+            }
+            m61_arena_chunk* c = m61_arena_chunk_new(tc, size, a->file, a->line);
+            if (!c) {
+                tc->stats.nfail.add(1);
+                tc->stats.fail_size.add(sz);
+                return nullptr;
+            }
+            a->current->next = c;
+            if (a->next_chunk_size < M61_ARENA_MAX_CHUNK) {
+                a->next_chunk_size *= 2;
+            }
         }
-        ptr = &default_buffer.buffer[default_buffer.pos];
-        default_buffer.pos += total_size;
+        a->current = a->current->next;
+        a->pos = m61_arena_start(a, a->current);
+        p = ((uintptr_t) a->pos + align - 1) & ~(uintptr_t) (align - 1);
     }
+    a->pos = (char*) p + sz;
 
-    // Initialize the extra 8 bytes at the end
-    memset((char*)ptr + sz, 0xAB, 8); 
-        
+    a->nactive.add(1);
+    a->active_size.add(sz);
+    tc->stats.total_size.add(sz);
+    tc->stats.active_size.add(sz);
+    tc->stats.nactive.add(1);
+    tc->stats.ntotal.add(1);
+    m61_site_alloc(a->file, a->line, sz);
+    return (void*) p;
+}
 
-    //update the max and min memory location
-    if ((uintptr_t) ptr < gstats.heap_min || gstats.heap_min == UINTPTR_MAX) {
-    gstats.heap_min = (uintptr_t) ptr;
-    }
 
-    if ((uintptr_t) ptr + total_size - 1 > gstats.heap_max) {
-        gstats.heap_max = (uintptr_t) ptr + total_size - 1;
+/// m61_arena_reset(a)
+///    Frees every allocation in arena `a` at once. The arena keeps its
+///    memory for later allocations.
+
+void m61_arena_reset(m61_arena* a) {
+    m61_tcache* tc = m61_get_tcache();
+    tc->stats.nactive.add(-a->nactive.get());
+    tc->stats.active_size.add(-a->active_size.get());
+    m61_site_free(a->file, a->line, a->active_size.get());
+    a->nactive.value.store(0, std::memory_order_relaxed);
+    a->active_size.value.store(0, std::memory_order_relaxed);
+    a->current = a->first;
+    a->pos = m61_arena_start(a, a->first);
+}
+
+
+/// m61_arena_destroy(a)
+///    Frees every allocation in arena `a`, and the arena itself.
+
+void m61_arena_destroy(m61_arena* a) {
+    if (!a) {
+        return;
+    }
+    m61_arena_reset(a);
+    {
+        std::unique_lock<std::mutex> guard(heap_lock);
+        (a->prev ? a->prev->next : arena_list) = a->next;
+        if (a->next) {
+            a->next->prev = a->prev;
+        }
+    }
+    m61_arena_chunk* c = a->first;
+    a->~m61_arena();
+    while (c) {
+        m61_arena_chunk* next = c->next;
+        m61_arena_chunk_free(c);
+        c = next;
     }
+}
 
 
-    active_allocation_map[ptr] = {sz, file, line};
-    gstats.total_size += sz;
-    gstats.active_size += sz;
-    ++gstats.nactive;
-    ++gstats.ntotal;
+// Pools. An `m61_pool<T>` (see m61.hh) keeps freed slots on an intrusive
+// free list and carves new ones from slabs, which are arena chunks. Only
+// running out of both reaches `m61_pool_refill`. Live pools are linked
+// into `pool_list`, protected by `tcache_list_lock`, so that
+// `m61_get_statistics` can count their allocations; a destroyed pool's
+// counts move to `retired_stats`.
 
-    return ptr;
+static constexpr size_t M61_POOL_SLAB = 16 << 10;
 
+static m61_pool_base* pool_list;
+
+static void m61_add_pool_stats(m61_statistics& stats, const m61_pool_base* p) {
+    unsigned long long ntotal = p->ntotal.load(std::memory_order_relaxed);
+    unsigned long long nactive = ntotal - p->nfreed.load(std::memory_order_relaxed);
+    stats.ntotal += ntotal;
+    stats.total_size += ntotal * p->object_size;
+    stats.nactive += nactive;
+    stats.active_size += nactive * p->object_size;
 }
 
 
-/// m61_free(ptr, file, line)
-///    Frees the memory allocation pointed to by `ptr`. If `ptr == nullptr`,
-///    does nothing. Otherwise, `ptr` must point to a currently active
-///    allocation returned by `m61_malloc`. The free was called at location
-///    `file`:`line`.
+/// m61_pool_init(p, object_size, slot_size, slot_align, file, line)
+///    Initializes the pool `p` for objects of `object_size` bytes stored in
+///    slots of `slot_size` bytes aligned to `slot_align`.
 
-void m61_free(void* ptr, const char* file, int line) {
-    // avoid uninitialized variable warnings
-    (void) ptr, (void) file, (void) line;
+void m61_pool_init(m61_pool_base* p, size_t object_size, size_t slot_size,
+                   size_t slot_align, const char* file, int line) {
+    p->free_list = nullptr;
+    p->bump = p->bump_end = nullptr;
+    p->slabs = nullptr;
+    p->object_size = object_size;
+    p->slot_size = slot_size;
+    p->slot_align = slot_align;
+    p->file = file;
+    p->line = line;
+    p->ntotal.store(0, std::memory_order_relaxed);
+    p->nfreed.store(0, std::memory_order_relaxed);
 
-    if (ptr == nullptr ){
-        return;
+    std::unique_lock<std::mutex> guard(tcache_list_lock);
+    p->prev = nullptr;
+    p->next = pool_list;
+    if (pool_list) {
+        pool_list->prev = p;
     }
+    pool_list = p;
+}
 
-     // Check if the pointer was already freed (double free detection)
-    if (free_allocation_map.find(ptr) != free_allocation_map.end()) {
-        fprintf(stderr, "MEMORY BUG: %s:%d: invalid free of pointer %p, double free\n", file, line, ptr);
-        abort();
+
+/// m61_pool_refill(p)
+///    Allocates a new slab for pool `p` and returns a slot from it, or
+///    returns `nullptr` if out of memory.
+
+void* m61_pool_refill(m61_pool_base* p) {
+    m61_tcache* tc = m61_get_tcache();
+    size_t size = M61_POOL_SLAB;
+    if (size < 8 * p->slot_size + p->slot_align) {
+        size = 8 * p->slot_size + p->slot_align;
+    }
+    m61_arena_chunk* c = m61_arena_chunk_new(tc, size, p->file, p->line);
+    if (!c) {
+        tc->stats.nfail.add(1);
+        tc->stats.fail_size.add(p->object_size);
+        return nullptr;
     }
+    c->next = static_cast<m61_arena_chunk*>(p->slabs);
+    p->slabs = c;
+    uintptr_t start = ((uintptr_t) (c + 1) + p->slot_align - 1) & ~(uintptr_t) (p->slot_align - 1);
+    p->bump = (char*) start + p->slot_size;
+    p->bump_end = (char*) start + (c->end - (char*) start) / p->slot_size * p->slot_size;
+    return (void*) start;
+}
 
-    auto it = active_allocation_map.find(ptr);
-    // Check if the pointer falls within the heap range
-    if ((uintptr_t)ptr >= gstats.heap_min && (uintptr_t)ptr <= gstats.heap_max) {
-        // If it’s in the heap but not allocated
-        if (it == active_allocation_map.end()) {
-            fprintf(stderr, "MEMORY BUG: %s:%d: invalid free of pointer %p, not allocated\n", file, line, ptr);
-            abort();
+
+/// m61_pool_destroy(p)
+///    Frees all of pool `p`'s slabs. Any objects still in the pool are
+///    freed too.
+
+void m61_pool_destroy(m61_pool_base* p) {
+    {
+        std::unique_lock<std::mutex> guard(tcache_list_lock);
+        (p->prev ? p->prev->next : pool_list) = p->next;
+        if (p->next) {
+            p->next->prev = p->prev;
         }
-    } else {
-        // If pointer is not even in the heap
-        fprintf(stderr, "MEMORY BUG: %s:%d: invalid free of pointer %p, not in heap\n", file, line, ptr);
-        abort();
+        // Objects left in the pool are freed with it
+        unsigned long long ntotal = p->ntotal.load(std::memory_order_relaxed);
+        retired_stats.ntotal.add(ntotal);
+        retired_stats.total_size.add(ntotal * p->object_size);
+    }
+    while (m61_arena_chunk* c = static_cast<m61_arena_chunk*>(p->slabs)) {
+        p->slabs = c->next;
+        m61_arena_chunk_free(c);
     }
+}
 
-    size_t user_size = it->second.size;  // Size of the user-requested block
-    size_t total_size = user_size + 8; 
-    active_allocation_map.erase(it);
 
-    // Detect boundary write overflow before freeing
-    char* boundary_ptr = (char*)ptr + user_size;
-    for (int i = 0; i < 8; ++i) {
-        if ((unsigned char) boundary_ptr[i] != 0xAB) {  // Expect 0xAB if no boundary write occurred
-            fprintf(stderr, "MEMORY BUG: %s:%d: detected wild write during free of pointer %p\n", file, line, ptr);
-            abort();
+// m61_resident(addr, size)
+//    Return the number of bytes of the mapped range [addr, addr + size)
+//    that are resident in memory.
+
+static size_t m61_resident(char* addr, size_t size) {
+#ifdef __linux__
+    unsigned char vec[256];
+#else
+    char vec[256];
+#endif
+    size_t resident = 0;
+    for (size_t off = 0; off < size; off += sizeof(vec) * M61_PAGE_SIZE) {
+        size_t len = size - off < sizeof(vec) * M61_PAGE_SIZE ? size - off : sizeof(vec) * M61_PAGE_SIZE;
+        if (mincore(addr + off, len, vec) != 0) {
+            continue;
+        }
+        for (size_t i = 0; i != (len + M61_PAGE_SIZE - 1) / M61_PAGE_SIZE; ++i) {
+            resident += (vec[i] & 1) * M61_PAGE_SIZE;
         }
     }
+    return resident;
+}
 
-    
-    
-    //free space at pointer
-    memset(ptr, 0, user_size);
-    --gstats.nactive;
-    gstats.active_size -= user_size;
 
-    // Try to coalesce space with unused buffer memory
-    void* next_ptr = (char*) ptr + total_size;
-    if (next_ptr == (void*)(&default_buffer.buffer[default_buffer.pos])){
-        total_size +=  default_buffer.size - default_buffer.pos;
-        default_buffer.pos = (char*)ptr - default_buffer.buffer;
-    }
+// A mapped range measured by `m61_get_statistics`.
 
-    // Coalesce free space with free space
-    // Is there a free block at ptr + ptr size?
-    auto next_block = free_allocation_map.find(next_ptr);
+struct m61_range {
+    char* base;
+    size_t size;
+    bool huge;                          // arena has MADV_HUGEPAGE
+};
+
+// m61_huge_resident(ranges, n)
+//    Return the number of bytes of the huge-page ranges among the `n`
+//    `ranges` that are backed by huge pages, according to
+//    /proc/self/smaps, or 0 if that is unavailable.
 
-    if (next_block != free_allocation_map.end()){
-        total_size += next_block -> second;
-        free_allocation_map.erase(next_block);
+static size_t m61_huge_resident(const m61_range* ranges, size_t n) {
+    size_t total = 0;
+#ifdef __linux__
+    int fd = open("/proc/self/smaps", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
     }
+    bool in_heap = false;
+    char buf[4096];
+    size_t len = 0;
+    ssize_t r;
+    while ((r = read(fd, buf + len, sizeof(buf) - 1 - len)) > 0) {
+        len += r;
+        buf[len] = '\0';
+        char* line = buf;
+        while (char* nl = strchr(line, '\n')) {
+            *nl = '\0';
+            unsigned long start, end;
+            size_t kb;
+            if (sscanf(line, "%lx-%lx", &start, &end) == 2) {
+                // a new mapping: does it overlap a huge-page arena?
+                in_heap = false;
+                for (size_t i = 0; i != n; ++i) {
+                    if (ranges[i].huge
+                        && start < (uintptr_t) ranges[i].base + ranges[i].size
+                        && end > (uintptr_t) ranges[i].base) {
+                        in_heap = true;
+                    }
+                }
+            } else if (in_heap && sscanf(line, "AnonHugePages: %zu kB", &kb) == 1) {
+                total += kb << 10;
+            }
+            line = nl + 1;
+        }
+        len = buf + len - line;
+        memmove(buf, line, len);
+    }
+    close(fd);
+#endif
+    return total;
+}
 
-    // Is there a prev block to coalesce with?
-    auto prev_block = free_allocation_map.lower_bound(ptr);
-    if (prev_block != free_allocation_map.begin()){
-        -- prev_block;
-        if ((char*) prev_block -> first + prev_block -> second == ptr){
-            total_size += prev_block -> second;
-            ptr = prev_block -> first;
-            free_allocation_map.erase(prev_block);
+
+/// m61_get_statistics()
+///    Return the current memory statistics.
+
+m61_statistics m61_get_statistics() {
+    // Sum the counters of every live thread and of exited threads.
+    m61_statistics stats;
+    memset(&stats, 0, sizeof(m61_statistics));
+    {
+        std::unique_lock<std::mutex> guard(tcache_list_lock);
+        m61_add_thread_stats(stats, retired_stats);
+        for (m61_tcache* tc = tcache_list; tc; tc = tc->next) {
+            m61_add_thread_stats(stats, tc->stats);
+        }
+        for (m61_pool_base* p = pool_list; p; p = p->next) {
+            m61_add_pool_stats(stats, p);
         }
+    }
+    stats.heap_min = heap_min.load(std::memory_order_relaxed);
+    stats.heap_max = heap_max.load(std::memory_order_relaxed);
 
+    // Copy the arena and mapping ranges under `heap_lock`, then measure
+    // them without it: mincore and smaps cost time in proportion to the
+    // heap. A range unmapped in between is skipped by mincore.
+    m61_range arenas[M61_MAX_BUFFERS];
+    m61_range stack_maps[64];
+    m61_range* maps = stack_maps;
+    size_t narenas, nmaps, maps_cap = 64;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(heap_lock);
+            narenas = 0;
+            size_t n = nbuffers.load(std::memory_order_relaxed);
+            for (size_t i = 0; i != n; ++i) {
+                if (char* base = buffers[i].buffer.load(std::memory_order_relaxed)) {
+                    arenas[narenas++] = {base, buffers[i].size.load(std::memory_order_relaxed),
+                                         buffers[i].huge};
+                }
+            }
+            nmaps = nmappings;
+            if (nmaps <= maps_cap) {
+                size_t j = 0;
+                for (m61_mapping* m = mapping_list; m; m = m->next) {
+                    maps[j++] = {m->base, m61_size_of(m61_mapping_header(m)), false};
+                }
+                break;
+            }
+        }
+        // Too many mappings to copy: make room, with some to spare
+        size_t cap = nmaps * 2;
+        void* p = mmap(nullptr, cap * sizeof(m61_range), PROT_READ | PROT_WRITE,
+                       MAP_ANON | MAP_PRIVATE, -1, 0);
+        if (p == MAP_FAILED) {
+            nmaps = 0;
+            break;
+        }
+        if (maps != stack_maps) {
+            munmap(maps, maps_cap * sizeof(m61_range));
+        }
+        maps = static_cast<m61_range*>(p);
+        maps_cap = cap;
     }
 
-    free_allocation_map[ptr] = total_size;
+    bool any_huge = false;
+    for (size_t i = 0; i != narenas; ++i) {
+        stats.heap_rss += m61_resident(arenas[i].base, arenas[i].size);
+        any_huge = any_huge || arenas[i].huge;
+    }
+    if (any_huge) {
+        stats.heap_huge = m61_huge_resident(arenas, narenas);
+    }
+    for (size_t i = 0; i != nmaps; ++i) {
+        stats.heap_rss += m61_resident(maps[i].base, maps[i].size);
+    }
+    if (maps != stack_maps) {
+        munmap(maps, maps_cap * sizeof(m61_range));
+    }
+    return stats;
 }
 
 
-/// m61_calloc(count, sz, file, line)
-///    Returns a pointer a fresh dynamic memory allocation big enough to
-///    hold an array of `count` elements of `sz` bytes each. Returned
-///    memory is initialized to zero. The allocation request was at
-///    location `file`:`line`. Returns `nullptr` if out of memory; may
-///    also return `nullptr` if `count == 0` or `size == 0`.
-
-void* m61_calloc(size_t count, size_t sz, const char* file, int line) {
-    if (count != 0 && sz > SIZE_MAX/count){
-        //sz * count would cause an overflow
-        ++ gstats.nfail;
-        gstats.fail_size += SIZE_MAX;
-        return nullptr;
-    }
+/// m61_get_heap_info()
+///    Return a description of the heap's free space. The counts are kept
+///    up to date as the heap changes, so this takes no locks and does no
+///    work proportional to the heap; fields may be read a moment apart.
 
-    void* ptr = m61_malloc(count * sz, file, line);
-    if (ptr) {
-        memset(ptr, 0, count * sz);
+m61_heap_info m61_get_heap_info() {
+    m61_heap_info info;
+    info.free_blocks = heap_counters.free_blocks.get();
+    info.free_bytes = heap_counters.free_bytes.get();
+    info.largest_free = heap_counters.largest_free.get();
+    info.tail_bytes = heap_counters.tail_bytes.get();
+    info.parked_blocks = heap_counters.parked_blocks.get();
+    info.parked_bytes = heap_counters.parked_bytes.get();
+    info.fragmentation = 0;
+    if (info.free_bytes != 0 && info.largest_free <= info.free_bytes) {
+        info.fragmentation = 1 - double(info.largest_free) / info.free_bytes;
     }
-    return ptr;
+    return info;
 }
 
 
-/// m61_get_statistics()
-///    Return the current memory statistics.
+// Reports go to a stdio stream, or, for `m61_write_report`, straight to
+// a file descriptor: each line is formatted on the stack and written
+// with write(2), so that a report made at exit neither allocates nor
+// relies on streams the program has already closed.
 
-m61_statistics m61_get_statistics() {
-    // The handout code sets all statistics to enormous numbers.
-    // m61_statistics stats;
-    // memset(&stats, 0, sizeof(m61_statistics));
-    // stats.ntotal = gstats.ntotal;
-    return gstats;
+struct m61_report_out {
+    FILE* f;                    // stream, or nullptr to use `fd`
+    int fd;
+};
+
+__attribute__((format(printf, 2, 3)))
+static void m61_report(const m61_report_out& out, const char* format, ...) {
+    va_list val;
+    va_start(val, format);
+    if (out.f) {
+        vfprintf(out.f, format, val);
+    } else {
+        char buf[512];
+        int n = vsnprintf(buf, sizeof(buf), format, val);
+        size_t len = n < 0 ? 0 : size_t(n) < sizeof(buf) ? n : sizeof(buf) - 1;
+        for (size_t off = 0; off < len; ) {
+            ssize_t w = write(out.fd, buf + off, len - off);
+            if (w > 0) {
+                off += w;
+            } else if (w == 0 || errno != EINTR) {
+                break;
+            }
+        }
+    }
+    va_end(val);
+}
+
+static void m61_report_statistics(const m61_report_out& out) {
+    m61_statistics stats = m61_get_statistics();
+    m61_report(out, "alloc count: active %10llu   total %10llu   fail %10llu\n",
+               stats.nactive, stats.ntotal, stats.nfail);
+    m61_report(out, "alloc size:  active %10llu   total %10llu   fail %10llu\n",
+               stats.active_size, stats.total_size, stats.fail_size);
 }
 
+static void m61_report_leaks(const m61_report_out& out);
+static void m61_report_sites(const m61_report_out& out, size_t top_n);
+
 
 /// m61_print_statistics()
 ///    Prints the current memory statistics.
 
 void m61_print_statistics() {
-    m61_statistics stats = m61_get_statistics();
-    printf("alloc count: active %10llu   total %10llu   fail %10llu\n",
-           stats.nactive, stats.ntotal, stats.nfail);
-    printf("alloc size:  active %10llu   total %10llu   fail %10llu\n",
-           stats.active_size, stats.total_size, stats.fail_size);
+    m61_report_statistics({stdout, -1});
 }
 
 
@@ -274,10 +2508,175 @@ void m61_print_statistics() {
 ///    memory.
 
 void m61_print_leak_report() {
-    for (const auto& entry : active_allocation_map) {
-        void* ptr = entry.first;    
-        AllocationInfo info = entry.second; // Get the size, file, and line number
+    m61_report_leaks({stdout, -1});
+}
+
+static void m61_report_leaks(const m61_report_out& out) {
+    std::unique_lock<std::mutex> guard(heap_lock);
+    size_t n = nbuffers.load(std::memory_order_relaxed);
+    for (size_t i = 0; i != n; ++i) {
+        m61_memory_buffer& buf = buffers[i];
+        char* base = buf.buffer.load(std::memory_order_relaxed);
+        if (!base) {
+            continue;
+        }
+        for (m61_header* h = reinterpret_cast<m61_header*>(base);
+             (char*) h < m61_frontier(&buf);
+             h = m61_next_block(h)) {
+            if (h->magic == m61_magic(h, true)) {
+                m61_report(out, "LEAK CHECK: %s:%d: allocated object %p with size %zu\n", h->file, h->line, m61_payload(h), h->size);
+            }
+        }
+    }
+    for (m61_mapping* m = mapping_list; m; m = m->next) {
+        m61_header* h = m61_mapping_header(m);
+        if (h->magic != m61_magic(h, true)) {
+            continue;
+        }
+        m61_report(out, "LEAK CHECK: %s:%d: allocated object %p with size %zu\n", h->file, h->line, m61_payload(h), h->size);
+    }
+    for (m61_arena* a = arena_list; a; a = a->next) {
+        if (a->nactive.get() != 0) {
+            m61_report(out, "LEAK CHECK: %s:%d: arena %p holds %llu objects with size %llu\n",
+                       a->file, a->line, a, a->nactive.get(), a->active_size.get());
+        }
+    }
+    std::unique_lock<std::mutex> pool_guard(tcache_list_lock);
+    for (m61_pool_base* p = pool_list; p; p = p->next) {
+        unsigned long long nactive = p->ntotal.load(std::memory_order_relaxed)
+            - p->nfreed.load(std::memory_order_relaxed);
+        if (nactive != 0) {
+            m61_report(out, "LEAK CHECK: %s:%d: pool %p holds %llu objects with size %zu\n",
+                       p->file, p->line, p, nactive, p->object_size);
+        }
+    }
+}
 
-        printf("LEAK CHECK: %s:%d: allocated object %p with size %zu\n", info.file, info.line, ptr, info.size);
+
+/// m61_print_site_report(top_n)
+///    Prints the `top_n` allocation sites that allocated the most bytes,
+///    with their allocation counts and current and peak active bytes.
+
+void m61_print_site_report(size_t top_n) {
+    m61_report_sites({stdout, -1}, top_n);
+}
+
+static void m61_report_sites(const m61_report_out& out, size_t top_n) {
+    // Select the next-largest site `top_n` times; ties go to the lower slot
+    size_t prev = M61_NSITES + 1;
+    unsigned long long prev_bytes = ULLONG_MAX;
+    for (size_t n = 0; n != top_n; ++n) {
+        size_t best = M61_NSITES + 1;
+        unsigned long long best_bytes = 0;
+        for (size_t i = 0; i <= M61_NSITES; ++i) {
+            m61_site* s = i == M61_NSITES ? &site_overflow : &sites[i];
+            unsigned long long b = s->bytes.load(std::memory_order_relaxed);
+            if (s->count.load(std::memory_order_relaxed) != 0
+                && (b < prev_bytes || (b == prev_bytes && i > prev))
+                && (best > M61_NSITES || b > best_bytes)) {
+                best = i;
+                best_bytes = b;
+            }
+        }
+        if (best > M61_NSITES) {
+            break;
+        }
+        m61_site* s = best == M61_NSITES ? &site_overflow : &sites[best];
+        const char* file = s->file.load(std::memory_order_acquire);
+        m61_report(out, "SITE: %s:%d: %llu allocations, %llu bytes, %llu active bytes, %llu peak active bytes\n",
+                   file ? file : "(other)", file ? s->line : 0,
+                   s->count.load(std::memory_order_relaxed), best_bytes,
+                   s->live.load(std::memory_order_relaxed),
+                   s->peak.load(std::memory_order_relaxed));
+        prev = best;
+        prev_bytes = best_bytes;
+    }
+}
+
+
+/// m61_write_report(fd, top_n)
+///    Writes the statistics, the `top_n` allocation sites, and the leak
+///    report to file descriptor `fd`, without allocating memory.
+
+void m61_write_report(int fd, size_t top_n) {
+    m61_report_out out{nullptr, fd};
+    m61_report_statistics(out);
+    m61_report_sites(out, top_n);
+    m61_report_leaks(out);
+}
+
+
+/// m61_trace_start(filename)
+///    Start recording every allocation and free to the trace file
+///    `filename`, replacing any trace already running. Returns false if
+///    the file cannot be created.
+
+bool m61_trace_start(const char* filename) {
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        return false;
     }
+    m61_trace_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, M61_TRACE_MAGIC, sizeof(hdr.magic));
+    hdr.record_size = sizeof(m61_trace_record);
+    if (write(fd, &hdr, sizeof(hdr)) != ssize_t(sizeof(hdr))) {
+        close(fd);
+        return false;
+    }
+
+    m61_trace_stop();
+    std::unique_lock<std::mutex> guard(trace_lock);
+    for (size_t i = 0; i != M61_NSITES; ++i) {
+        sites[i].traced = false;
+    }
+    site_overflow.traced = false;
+    trace_fd = fd;
+    trace_epoch = m61_trace_clock();
+    tracing.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+
+/// m61_trace_stop()
+///    Finish the running trace, if any, and close its file.
+
+void m61_trace_stop() {
+    std::unique_lock<std::mutex> guard(trace_lock);
+    if (trace_fd >= 0) {
+        m61_trace_flush();
+        close(trace_fd);
+        trace_fd = -1;
+    }
+    tracing.store(false, std::memory_order_relaxed);
+}
+
+
+/// m61_get_options()
+///    Return the current allocator parameters.
+
+m61_options m61_get_options() {
+    m61_options opts;
+    opts.mmap_threshold = mmap_threshold.load(std::memory_order_relaxed);
+    opts.trim_threshold = trim_threshold.load(std::memory_order_relaxed);
+    opts.huge_pages = huge_pages.load(std::memory_order_relaxed);
+    opts.scrub = m61_scrub_policy(scrub_policy.load(std::memory_order_relaxed));
+    opts.quarantine_bytes = quarantine_limit.load(std::memory_order_relaxed);
+    opts.trust_sized_free = trust_sized_free.load(std::memory_order_relaxed);
+    return opts;
+}
+
+
+/// m61_set_options(opts)
+///    Change the allocator parameters. Changes affect later allocations,
+///    except that shrinking the quarantine releases blocks at once.
+
+void m61_set_options(const m61_options& opts) {
+    mmap_threshold.store(opts.mmap_threshold, std::memory_order_relaxed);
+    trim_threshold.store(opts.trim_threshold, std::memory_order_relaxed);
+    huge_pages.store(opts.huge_pages, std::memory_order_relaxed);
+    scrub_policy.store(opts.scrub, std::memory_order_relaxed);
+    quarantine_limit.store(opts.quarantine_bytes, std::memory_order_relaxed);
+    trust_sized_free.store(opts.trust_sized_free, std::memory_order_relaxed);
+    m61_quarantine_drain(m61_get_tcache(), opts.quarantine_bytes, "m61_set_options", 0);
 }
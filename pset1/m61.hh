@@ -6,6 +6,9 @@
 #include <cstdio>
 #include <new>
 #include <random>
+#include <memory_resource>
+#include <atomic>
+#include <utility>
 
 
 /// m61_malloc(sz, file, line)
@@ -16,6 +19,14 @@ void* m61_malloc(size_t sz, const char* file = __builtin_FILE(), int line = __bu
 ///    Free the memory space pointed to by `ptr`.
 void m61_free(void* ptr, const char* file = __builtin_FILE(), int line = __builtin_LINE());
 
+/// m61_free_sized(ptr, sz, file, line)
+///    Free the memory space pointed to by `ptr`, which was allocated with
+///    size `sz`. By default `ptr` is checked as in `m61_free`, and a wrong
+///    `sz` is reported. With the `trust_sized_free` option, `ptr` and `sz`
+///    are believed, which saves finding the block; a bad pointer then
+///    corrupts the heap rather than being reported.
+void m61_free_sized(void* ptr, size_t sz, const char* file = __builtin_FILE(), int line = __builtin_LINE());
+
 /// m61_calloc(count, sz, file, line)
 ///    Return a pointer to newly-allocated dynamic memory big enough to
 ///    hold an array of `count` elements of `sz` bytes each. The memory
@@ -23,6 +34,48 @@ void m61_free(void* ptr, const char* file = __builtin_FILE(), int line = __built
 void* m61_calloc(size_t count, size_t sz, const char* file = __builtin_FILE(), int line = __builtin_LINE());
 
 
+/// m61_realloc(ptr, sz, file, line)
+///    Change the size of the allocation pointed to by `ptr` to `sz` bytes,
+///    preserving its contents up to the smaller of the two sizes, and
+///    return a pointer to the (possibly moved) allocation.
+void* m61_realloc(void* ptr, size_t sz, const char* file = __builtin_FILE(), int line = __builtin_LINE());
+
+
+/// m61_usable_size(ptr)
+///    Return the size of the active allocation `ptr`.
+size_t m61_usable_size(void* ptr);
+
+/// m61_aligned_alloc(align, sz, file, line)
+///    Return a pointer to `sz` bytes of newly-allocated dynamic memory
+///    aligned to `align` bytes, a power of two. Free it with `m61_free`.
+///    Every allocation is at least 16-byte aligned.
+void* m61_aligned_alloc(size_t align, size_t sz, const char* file = __builtin_FILE(), int line = __builtin_LINE());
+
+
+/// m61_arena
+///    A region of memory whose allocations are all freed together. An
+///    arena may be used by one thread at a time.
+struct m61_arena;
+
+/// m61_arena_create(file, line)
+///    Return a new, empty arena.
+m61_arena* m61_arena_create(const char* file = __builtin_FILE(), int line = __builtin_LINE());
+
+/// m61_arena_alloc(a, sz, align, file, line)
+///    Return a pointer to `sz` bytes of memory from arena `a`, aligned to
+///    `align` bytes. The memory is freed when `a` is reset or destroyed.
+void* m61_arena_alloc(m61_arena* a, size_t sz, size_t align = alignof(std::max_align_t),
+                      const char* file = __builtin_FILE(), int line = __builtin_LINE());
+
+/// m61_arena_reset(a)
+///    Free every allocation in arena `a`, keeping its memory for reuse.
+void m61_arena_reset(m61_arena* a);
+
+/// m61_arena_destroy(a)
+///    Free every allocation in arena `a`, and `a` itself.
+void m61_arena_destroy(m61_arena* a);
+
+
 /// m61_statistics
 ///    Structure tracking memory statistics.
 struct m61_statistics {
@@ -34,8 +87,65 @@ struct m61_statistics {
     unsigned long long fail_size;       // # bytes in failed alloc attempts
     uintptr_t heap_min;                 // smallest allocated addr
     uintptr_t heap_max;                 // largest allocated addr
+    unsigned long long heap_rss;        // # heap bytes resident in memory
+    unsigned long long heap_huge;       // # heap bytes in huge pages
+};
+
+/// m61_heap_info
+///    Structure describing free space in the heap. Sizes are block
+///    sizes, including headers. Blocks held in per-thread caches count
+///    as neither free nor parked.
+struct m61_heap_info {
+    size_t free_blocks;                 // # free blocks inside arenas
+    size_t free_bytes;                  // # bytes in free blocks
+    size_t largest_free;                // size of the largest free block
+    size_t tail_bytes;                  // # never-allocated bytes above
+                                        // arena frontiers
+    size_t parked_blocks;               // # freed blocks awaiting
+                                        // coalescing (fast bins)
+    size_t parked_bytes;                // # bytes in parked blocks
+    double fragmentation;               // external fragmentation:
+                                        // 1 - largest_free / free_bytes
+};
+
+/// m61_get_heap_info()
+///    Return a description of the heap's free space. Cheap enough to
+///    poll from another thread; takes no locks.
+m61_heap_info m61_get_heap_info();
+
+/// m61_scrub_policy
+///    When `m61_free` clears freed memory.
+enum m61_scrub_policy {
+    M61_SCRUB_OFF,                      // never
+    M61_SCRUB_ON,                       // immediately (default)
+    M61_SCRUB_DEFERRED                  // in per-thread batches
 };
 
+/// m61_options
+///    Structure holding tunable allocator parameters.
+struct m61_options {
+    size_t mmap_threshold;              // allocations of at least this many
+                                        // bytes get their own mapping
+    size_t trim_threshold;              // free ranges of at least this many
+                                        // bytes are returned to the OS
+    bool huge_pages;                    // back new arenas with transparent
+                                        // huge pages if possible
+    m61_scrub_policy scrub;             // clearing of freed memory
+    size_t quarantine_bytes;            // hold up to this many bytes of
+                                        // freed blocks, poisoned, to catch
+                                        // use after free (0 = off)
+    bool trust_sized_free;              // `m61_free_sized` skips checking
+                                        // its pointer and size
+};
+
+/// m61_get_options()
+///    Return the current allocator parameters.
+m61_options m61_get_options();
+
+/// m61_set_options(opts)
+///    Change the allocator parameters. Changes affect later allocations.
+void m61_set_options(const m61_options& opts);
+
 // //free_block
 // struct free_block {
 //     size_t size;
@@ -55,6 +165,27 @@ void m61_print_statistics();
 ///    memory.
 void m61_print_leak_report();
 
+/// m61_print_site_report(top_n)
+///    Print the `top_n` allocation sites responsible for the most allocated
+///    bytes, with their allocation counts and active and peak bytes.
+void m61_print_site_report(size_t top_n = 10);
+
+/// m61_write_report(fd, top_n)
+///    Write the statistics, the `top_n` allocation sites, and the leak
+///    report to file descriptor `fd`. Does not allocate memory, so it is
+///    safe to call while a program exits.
+void m61_write_report(int fd, size_t top_n = 10);
+
+/// m61_trace_start(filename)
+///    Start recording every allocation and free to the trace file
+///    `filename`, for replay with `m61replay`. Returns false if the file
+///    cannot be created.
+bool m61_trace_start(const char* filename);
+
+/// m61_trace_stop()
+///    Finish the running trace and close its file.
+void m61_trace_stop();
+
 
 /// This magic class lets standard C++ containers use your allocator
 /// instead of the system allocator.
@@ -67,10 +198,14 @@ public:
     template <typename U> m61_allocator(m61_allocator<U>&) noexcept {}
 
     T* allocate(size_t n) {
-        return reinterpret_cast<T*>(m61_malloc(n * sizeof(T), "?", 0));
+        if constexpr (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+            return reinterpret_cast<T*>(m61_aligned_alloc(alignof(T), n * sizeof(T), "?", 0));
+        } else {
+            return reinterpret_cast<T*>(m61_malloc(n * sizeof(T), "?", 0));
+        }
     }
-    void deallocate(T* ptr, size_t) {
-        m61_free(ptr, "?", 0);
+    void deallocate(T* ptr, size_t n) {
+        m61_free_sized(ptr, n * sizeof(T), "?", 0);
     }
 };
 template <typename T, typename U>
@@ -78,6 +213,121 @@ inline constexpr bool operator==(const m61_allocator<T>&, const m61_allocator<U>
     return true;
 }
 
+/// m61_pool_base
+///    State shared by all `m61_pool` types. Used only by m61_pool.
+struct m61_pool_base {
+    void* free_list;                    // freed slots, linked through
+                                        // their first word
+    char* bump;                         // unused part of newest slab
+    char* bump_end;
+    void* slabs;
+    size_t object_size;
+    size_t slot_size;
+    size_t slot_align;
+    std::atomic<unsigned long long> ntotal;     // # allocations
+    std::atomic<unsigned long long> nfreed;     // # frees
+    const char* file;                   // creation site
+    int line;
+    m61_pool_base* prev;
+    m61_pool_base* next;
+};
+
+void m61_pool_init(m61_pool_base* p, size_t object_size, size_t slot_size,
+                   size_t slot_align, const char* file, int line);
+void* m61_pool_refill(m61_pool_base* p);
+void m61_pool_destroy(m61_pool_base* p);
+
+/// m61_pool<T>
+///    A pool of fixed-size slots for objects of type `T`, carved from slabs
+///    of m61 memory. Allocating and freeing usually just pop and push an
+///    intrusive free list. Pool allocations count in `m61_statistics`, and
+///    the leak report lists pools that still hold objects. A pool may be
+///    used by one thread at a time; destroying it frees its objects.
+template <typename T>
+class m61_pool {
+public:
+    static constexpr size_t slot_align = alignof(T) > alignof(void*) ? alignof(T) : alignof(void*);
+    static constexpr size_t slot_size =
+        ((sizeof(T) > sizeof(void*) ? sizeof(T) : sizeof(void*)) + slot_align - 1) & ~(slot_align - 1);
+
+    explicit m61_pool(const char* file = __builtin_FILE(), int line = __builtin_LINE()) {
+        m61_pool_init(&base_, sizeof(T), slot_size, slot_align, file, line);
+    }
+    ~m61_pool() {
+        m61_pool_destroy(&base_);
+    }
+    m61_pool(const m61_pool&) = delete;
+    m61_pool& operator=(const m61_pool&) = delete;
+
+    // Return uninitialized memory for one `T`, or nullptr if out of memory.
+    T* allocate() {
+        void* p = base_.free_list;
+        if (p) {
+            base_.free_list = *reinterpret_cast<void**>(p);
+        } else if (base_.bump != base_.bump_end) {
+            p = base_.bump;
+            base_.bump += slot_size;
+        } else if (!(p = m61_pool_refill(&base_))) {
+            return nullptr;
+        }
+        base_.ntotal.store(base_.ntotal.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return reinterpret_cast<T*>(p);
+    }
+    // Free memory returned by `allocate`.
+    void deallocate(T* ptr) {
+        if (ptr) {
+            *reinterpret_cast<void**>(ptr) = base_.free_list;
+            base_.free_list = ptr;
+            base_.nfreed.store(base_.nfreed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+    }
+
+    // Allocate and construct a `T`.
+    template <typename... Args>
+    T* create(Args&&... args) {
+        T* ptr = allocate();
+        return ptr ? new (ptr) T(std::forward<Args>(args)...) : nullptr;
+    }
+    // Destroy and free a `T` returned by `create`.
+    void destroy(T* ptr) {
+        if (ptr) {
+            ptr->~T();
+            deallocate(ptr);
+        }
+    }
+
+private:
+    m61_pool_base base_;
+};
+
+/// This class lets `std::pmr` containers allocate from an m61 arena.
+/// Deallocation does nothing; memory is reclaimed when the arena is reset.
+class m61_memory_resource : public std::pmr::memory_resource {
+public:
+    explicit m61_memory_resource(m61_arena* arena) noexcept
+        : arena_(arena) {
+    }
+    m61_arena* arena() const noexcept {
+        return arena_;
+    }
+
+private:
+    m61_arena* arena_;
+
+    void* do_allocate(size_t sz, size_t align) override {
+        void* ptr = m61_arena_alloc(arena_, sz, align, "?", 0);
+        if (!ptr) {
+            throw std::bad_alloc();
+        }
+        return ptr;
+    }
+    void do_deallocate(void*, size_t, size_t) override {
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
 /// Returns a random integer between `min` and `max`, using randomness from
 /// `randomness`.
 template <typename Engine, typename T>
@@ -0,0 +1,319 @@
+#include "m61.hh"
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <unistd.h>
+
+// m61bench: allocator microbenchmarks.
+//
+//     m61bench [-a m61|system] [-n OPS] [WORKLOAD...]
+//
+// Runs each workload (default: all) for about OPS operations (default
+// 1000000), once against m61 and once against the system malloc, unless
+// `-a` picks one. Each row reports throughput over the whole run,
+// percentiles of the time taken by individual mallocs and frees, and the
+// peak heap span: the distance between the lowest and highest byte
+// allocated during the run. `make bench` builds and runs it without
+// sanitizers.
+//
+// Workloads:
+//    churn     free and reallocate 64-byte blocks among 64 slots
+//    random    free and reallocate 1..4096-byte blocks among 4096 slots
+//    prodcon   2 producer threads allocate blocks that 2 consumer
+//              threads free
+//    ladder    allocate rounds of ever-larger blocks, freeing every
+//              other block of the previous round, so holes never fit
+//    sites     like test33: random sizes from 40000 file:line sites
+
+using clock_type = std::chrono::steady_clock;
+
+// Per-thread measurements.
+struct bench_thread {
+    std::vector<unsigned> ns;           // latency of each operation
+    uintptr_t lo = UINTPTR_MAX;         // lowest byte allocated
+    uintptr_t hi = 0;                   // highest byte allocated + 1
+};
+
+template <typename A>
+static void* timed_alloc(bench_thread& t, size_t sz,
+                         const char* file = "?", int line = 0) {
+    auto t0 = clock_type::now();
+    void* ptr = A::alloc(sz, file, line);
+    auto t1 = clock_type::now();
+    t.ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+    uintptr_t addr = reinterpret_cast<uintptr_t>(ptr);
+    t.lo = std::min(t.lo, addr);
+    t.hi = std::max(t.hi, addr + sz);
+    return ptr;
+}
+
+template <typename A>
+static void timed_free(bench_thread& t, void* ptr,
+                       const char* file = "?", int line = 0) {
+    if (ptr) {
+        auto t0 = clock_type::now();
+        A::release(ptr, file, line);
+        auto t1 = clock_type::now();
+        t.ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+    }
+}
+
+
+// Allocators under test.
+
+struct m61_bench_alloc {
+    static void* alloc(size_t sz, const char* file, int line) {
+        return m61_malloc(sz, file, line);
+    }
+    static void release(void* ptr, const char* file, int line) {
+        m61_free(ptr, file, line);
+    }
+};
+
+struct system_bench_alloc {
+    static void* alloc(size_t sz, const char*, int) {
+        return malloc(sz);
+    }
+    static void release(void* ptr, const char*, int) {
+        free(ptr);
+    }
+};
+
+
+// Workloads. Each runs about `n` operations, split across the threads
+// in `ts`.
+
+template <typename A>
+static void bench_churn(std::vector<bench_thread>& ts, size_t n) {
+    bench_thread& t = ts[0];
+    void* slots[64] = {};
+    for (size_t i = 0; i < n / 2; ++i) {
+        timed_free<A>(t, slots[i % 64]);
+        slots[i % 64] = timed_alloc<A>(t, 64);
+    }
+    for (void* p : slots) {
+        timed_free<A>(t, p);
+    }
+}
+
+template <typename A>
+static void bench_random(std::vector<bench_thread>& ts, size_t n) {
+    bench_thread& t = ts[0];
+    std::default_random_engine randomness(61);
+    std::vector<void*> slots(4096, nullptr);
+    for (size_t i = 0; i < n / 2; ++i) {
+        size_t slot = uniform_int(size_t(0), slots.size() - 1, randomness);
+        // sizes are spread evenly over each power of two
+        size_t sz = uniform_int(size_t(1), size_t(1) << uniform_int(0, 12, randomness),
+                                randomness);
+        timed_free<A>(t, slots[slot]);
+        slots[slot] = timed_alloc<A>(t, sz);
+    }
+    for (void* p : slots) {
+        timed_free<A>(t, p);
+    }
+}
+
+// A single-producer, single-consumer queue of pointers.
+struct bench_ring {
+    static constexpr size_t size = 1024;
+    void* slots[size];
+    alignas(64) std::atomic<size_t> head{0};    // next slot to fill
+    alignas(64) std::atomic<size_t> tail{0};    // next slot to empty
+};
+
+template <typename A>
+static void bench_prodcon(std::vector<bench_thread>& ts, size_t n) {
+    const size_t npairs = 2, nitems = n / npairs / 2;
+    ts.resize(2 * npairs);
+    std::vector<bench_ring> rings(npairs);     // one per pair
+    std::vector<std::thread> threads;
+    for (size_t p = 0; p != npairs; ++p) {
+        threads.emplace_back([&, p] {
+            bench_thread& t = ts[2 * p];
+            bench_ring& r = rings[p];
+            std::default_random_engine randomness(p);
+            for (size_t i = 0; i != nitems; ++i) {
+                void* ptr = timed_alloc<A>(t, uniform_int(16, 512, randomness));
+                size_t head = r.head.load(std::memory_order_relaxed);
+                while (head - r.tail.load(std::memory_order_acquire) == bench_ring::size) {
+                    std::this_thread::yield();
+                }
+                r.slots[head % bench_ring::size] = ptr;
+                r.head.store(head + 1, std::memory_order_release);
+            }
+        });
+        threads.emplace_back([&, p] {
+            bench_thread& t = ts[2 * p + 1];
+            bench_ring& r = rings[p];
+            for (size_t i = 0; i != nitems; ++i) {
+                size_t tail = r.tail.load(std::memory_order_relaxed);
+                while (r.head.load(std::memory_order_acquire) == tail) {
+                    std::this_thread::yield();
+                }
+                void* ptr = r.slots[tail % bench_ring::size];
+                r.tail.store(tail + 1, std::memory_order_release);
+                timed_free<A>(t, ptr);
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+}
+
+template <typename A>
+static void bench_ladder(std::vector<bench_thread>& ts, size_t n) {
+    bench_thread& t = ts[0];
+    const size_t per_round = 512;
+    std::vector<void*> kept, round;
+    size_t sz = 16;
+    for (size_t ops = 0; ops < n; ops += per_round + per_round / 2) {
+        // free every other block of the last round, leaving holes too
+        // small for this round's blocks
+        for (size_t i = 0; i < round.size(); ++i) {
+            if (i % 2) {
+                timed_free<A>(t, round[i]);
+            } else {
+                kept.push_back(round[i]);
+            }
+        }
+        round.clear();
+        for (size_t i = 0; i != per_round; ++i) {
+            round.push_back(timed_alloc<A>(t, sz));
+        }
+        sz = sz < 2048 ? sz + 16 : 16;
+        // start over once the survivors hold a few MiB
+        if (kept.size() > 8192) {
+            for (void* p : kept) {
+                timed_free<A>(t, p);
+            }
+            kept.clear();
+        }
+    }
+    for (void* p : kept) {
+        timed_free<A>(t, p);
+    }
+    for (void* p : round) {
+        timed_free<A>(t, p);
+    }
+}
+
+template <typename A>
+static void bench_sites(std::vector<bench_thread>& ts, size_t n) {
+    bench_thread& t = ts[0];
+    static char files[200][16];
+    for (int i = 0; i != 200; ++i) {
+        snprintf(files[i], sizeof(files[i]), "site%03d.cc", i);
+    }
+    std::default_random_engine randomness(33);
+    void* slots[200] = {};
+    for (size_t i = 0; i < n / 2; ++i) {
+        const char* file = files[uniform_int(0, 199, randomness)];
+        int line = uniform_int(1, 200, randomness);
+        void* ptr = timed_alloc<A>(t, uniform_int(1, 128, randomness), file, line);
+        int slot = uniform_int(0, 199, randomness);
+        timed_free<A>(t, slots[slot], file, line + 3);
+        slots[slot] = ptr;
+    }
+    for (void* p : slots) {
+        timed_free<A>(t, p);
+    }
+}
+
+
+struct workload {
+    const char* name;
+    void (*m61)(std::vector<bench_thread>&, size_t);
+    void (*system)(std::vector<bench_thread>&, size_t);
+};
+
+#define WORKLOAD(name) \
+    { #name, bench_##name<m61_bench_alloc>, bench_##name<system_bench_alloc> }
+
+static const workload workloads[] = {
+    WORKLOAD(churn), WORKLOAD(random), WORKLOAD(prodcon),
+    WORKLOAD(ladder), WORKLOAD(sites)
+};
+
+// run(w, fn, allocator, n)
+//    Run workload `w` with implementation `fn` and print its results.
+
+static void run(const workload& w, void (*fn)(std::vector<bench_thread>&, size_t),
+                const char* allocator, size_t n) {
+    std::vector<bench_thread> ts(1);
+    ts[0].ns.reserve(n + n / 8);
+    auto t0 = clock_type::now();
+    fn(ts, n);
+    double secs = std::chrono::duration<double>(clock_type::now() - t0).count();
+
+    std::vector<unsigned> ns;
+    uintptr_t lo = UINTPTR_MAX, hi = 0;
+    for (auto& t : ts) {
+        ns.insert(ns.end(), t.ns.begin(), t.ns.end());
+        lo = std::min(lo, t.lo);
+        hi = std::max(hi, t.hi);
+    }
+    std::sort(ns.begin(), ns.end());
+    auto pct = [&] (double p) {
+        return ns.empty() ? 0U : ns[size_t(p / 100 * (ns.size() - 1) + 0.5)];
+    };
+    printf("%-8s %-7s %9zu %12.0f %6u %6u %6u %7u %8u %12zu\n",
+           w.name, allocator, ns.size(), ns.size() / secs,
+           pct(50), pct(90), pct(99), pct(99.9), pct(100),
+           hi > lo ? size_t(hi - lo) : size_t(0));
+    fflush(stdout);
+}
+
+static void usage() {
+    fprintf(stderr, "Usage: m61bench [-a m61|system] [-n OPS] [WORKLOAD...]\n");
+    exit(1);
+}
+
+int main(int argc, char** argv) {
+    bool use_m61 = true, use_system = true;
+    size_t n = 1000000;
+    int opt;
+    while ((opt = getopt(argc, argv, "a:n:")) != -1) {
+        if (opt == 'a' && strcmp(optarg, "m61") == 0) {
+            use_system = false;
+        } else if (opt == 'a' && strcmp(optarg, "system") == 0) {
+            use_m61 = false;
+        } else if (opt == 'n') {
+            n = strtoul(optarg, nullptr, 0);
+        } else {
+            usage();
+        }
+    }
+
+    std::vector<const workload*> todo;
+    for (int i = optind; i < argc; ++i) {
+        auto it = std::find_if(std::begin(workloads), std::end(workloads),
+                               [&] (const workload& w) { return strcmp(w.name, argv[i]) == 0; });
+        if (it == std::end(workloads)) {
+            fprintf(stderr, "m61bench: no workload %s\n", argv[i]);
+            usage();
+        }
+        todo.push_back(it);
+    }
+    if (todo.empty()) {
+        for (auto& w : workloads) {
+            todo.push_back(&w);
+        }
+    }
+
+    printf("%-8s %-7s %9s %12s %6s %6s %6s %7s %8s %12s\n",
+           "workload", "alloc", "ops", "ops/sec", "p50ns", "p90ns",
+           "p99ns", "p99.9ns", "maxns", "span");
+    for (const workload* w : todo) {
+        if (use_m61) {
+            run(*w, w->m61, "m61", n);
+        }
+        if (use_system) {
+            run(*w, w->system, "system", n);
+        }
+    }
+}
@@ -0,0 +1,365 @@
+#include "m61.hh"
+#include <cerrno>
+#include <cstring>
+#include <climits>
+#include <atomic>
+#include <fcntl.h>
+#include <unistd.h>
+
+// libm61.so: an LD_PRELOAD shim that makes the m61 allocator the process's
+// malloc, for programs that were not compiled against m61.hh.
+//
+//     make libm61.so && LD_PRELOAD=./libm61.so program...
+//
+// The m61 engine is thread-safe and never calls malloc itself, so the
+// wrappers below just forward. Unmodified programs have no `file`:`line`
+// to report, so each allocation site is named by its return address,
+// formatted as a string and interned in `pc_names`; reports show it as
+// `0x...:0`. If M61_TRACE is set, every allocation is traced to the file
+// it names, for replay with `m61replay`; a `%p` in the name is replaced
+// with the process ID, so that the programs a command runs get traces of
+// their own. M61_QUARANTINE=BYTES sets the `quarantine_bytes` option, so
+// that use after free is detected, and M61_TRUST_SIZED_FREE=1 sets the
+// `trust_sized_free` option, so that sized deletes skip pointer checks.
+//
+// If M61_REPORT is set, the statistics, the top allocation sites, and the
+// leak report are written at exit: to standard error if its value is `1`,
+// and otherwise appended to the file it names, `%p` expanded as above.
+// Only the process that loaded the shim reports. M61_REPORT is removed
+// from its environment, so the programs it runs stay quiet, and a forked
+// child does not repeat its parent's report.
+
+
+// Interned return-address names. A slot is claimed by setting `pc` and
+// becomes usable when `ready` is set; names are never removed. If the
+// table fills up, further sites share the name "?". The table is
+// constant-initialized, because it is in use before the shim's own
+// constructors run.
+
+struct m61_pc_name {
+    std::atomic<uintptr_t> pc{0};
+    std::atomic<bool> ready{false};
+    char name[2 * sizeof(uintptr_t) + 3] = {};
+};
+
+static constexpr size_t M61_NPCNAMES = 16384;
+static constinit m61_pc_name pc_names[M61_NPCNAMES];
+
+// m61_site(pc)
+//    Return the interned name of return address `pc`.
+
+static const char* m61_site(const void* pc) {
+    uintptr_t key = (uintptr_t) pc;
+    size_t i = (key * 0x9E3779B97F4A7C15ULL) >> 50;
+    static_assert(M61_NPCNAMES == size_t(1) << (64 - 50), "hash fills the table");
+    for (size_t probes = 0; probes != M61_NPCNAMES; ++probes, i = (i + 1) % M61_NPCNAMES) {
+        m61_pc_name& n = pc_names[i];
+        uintptr_t cur = n.pc.load(std::memory_order_acquire);
+        if (cur == 0
+            && n.pc.compare_exchange_strong(cur, key, std::memory_order_acq_rel)) {
+            // claimed: format the address without calling into stdio
+            char* p = n.name;
+            *p++ = '0';
+            *p++ = 'x';
+            int shift = 4 * (2 * sizeof(uintptr_t) - 1);
+            while (shift > 0 && ((key >> shift) & 15) == 0) {
+                shift -= 4;
+            }
+            for (; shift >= 0; shift -= 4) {
+                *p++ = "0123456789abcdef"[(key >> shift) & 15];
+            }
+            *p = '\0';
+            n.ready.store(true, std::memory_order_release);
+            return n.name;
+        }
+        if (cur == key) {
+            while (!n.ready.load(std::memory_order_acquire)) {
+            }
+            return n.name;
+        }
+    }
+    return "?";
+}
+
+#define M61_SITE m61_site(__builtin_return_address(0)), 0
+
+
+// m61_expand_pid(buf, size, pattern)
+//    Copy `pattern` into `buf`, replacing each `%p` with the process ID.
+
+static void m61_expand_pid(char* buf, size_t size, const char* pattern) {
+    size_t n = 0;
+    for (const char* p = pattern; *p && n < size - 24; ++p) {
+        if (p[0] == '%' && p[1] == 'p') {
+            n += snprintf(buf + n, 24, "%ld", long(getpid()));
+            ++p;
+        } else {
+            buf[n++] = *p;
+        }
+    }
+    buf[n] = '\0';
+}
+
+
+extern "C" {
+
+void* malloc(size_t sz) {
+    void* ptr = m61_malloc(sz ? sz : 1, M61_SITE);
+    if (!ptr) {
+        errno = ENOMEM;
+    }
+    return ptr;
+}
+
+void free(void* ptr) {
+    m61_free(ptr, M61_SITE);
+}
+
+void* calloc(size_t count, size_t sz) {
+    if (count == 0 || sz == 0) {
+        count = sz = 1;
+    }
+    void* ptr = m61_calloc(count, sz, M61_SITE);
+    if (!ptr) {
+        errno = ENOMEM;
+    }
+    return ptr;
+}
+
+void* realloc(void* ptr, size_t sz) {
+    // realloc(nullptr, 0) is malloc(0), which must not look like failure
+    void* new_ptr = m61_realloc(ptr, ptr || sz ? sz : 1, M61_SITE);
+    if (!new_ptr && sz) {
+        errno = ENOMEM;
+    }
+    return new_ptr;
+}
+
+void* reallocarray(void* ptr, size_t count, size_t sz) {
+    if (count != 0 && sz > SIZE_MAX / count) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    size_t total = count * sz;
+    void* new_ptr = m61_realloc(ptr, ptr || total ? total : 1, M61_SITE);
+    if (!new_ptr && total) {
+        errno = ENOMEM;
+    }
+    return new_ptr;
+}
+
+int posix_memalign(void** ptr, size_t align, size_t sz) {
+    if (align % sizeof(void*) != 0 || (align & (align - 1)) != 0) {
+        return EINVAL;
+    }
+    void* p = m61_aligned_alloc(align, sz ? sz : 1, M61_SITE);
+    if (!p) {
+        return ENOMEM;
+    }
+    *ptr = p;
+    return 0;
+}
+
+void* aligned_alloc(size_t align, size_t sz) {
+    void* ptr = m61_aligned_alloc(align, sz ? sz : 1, M61_SITE);
+    if (!ptr) {
+        errno = align && (align & (align - 1)) == 0 ? ENOMEM : EINVAL;
+    }
+    return ptr;
+}
+
+void* memalign(size_t align, size_t sz) {
+    void* ptr = m61_aligned_alloc(align, sz ? sz : 1, M61_SITE);
+    if (!ptr) {
+        errno = align && (align & (align - 1)) == 0 ? ENOMEM : EINVAL;
+    }
+    return ptr;
+}
+
+void* valloc(size_t sz) {
+    void* ptr = m61_aligned_alloc(sysconf(_SC_PAGESIZE), sz ? sz : 1, M61_SITE);
+    if (!ptr) {
+        errno = ENOMEM;
+    }
+    return ptr;
+}
+
+void* pvalloc(size_t sz) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    if (sz > SIZE_MAX - page + 1) {
+        // rounding up to a page would wrap around
+        errno = ENOMEM;
+        return nullptr;
+    }
+    void* ptr = m61_aligned_alloc(page, sz ? (sz + page - 1) & ~(page - 1) : page, M61_SITE);
+    if (!ptr) {
+        errno = ENOMEM;
+    }
+    return ptr;
+}
+
+size_t malloc_usable_size(void* ptr) {
+    return m61_usable_size(ptr);
+}
+
+}
+
+
+// C++ allocation functions. `operator new` throws on failure; the
+// sized `operator delete`s pass their size to `m61_free_sized`.
+
+static void* m61_new(size_t sz, const char* file, int line) {
+    void* ptr = m61_malloc(sz ? sz : 1, file, line);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+static void* m61_new_aligned(size_t sz, std::align_val_t align, const char* file, int line) {
+    void* ptr = m61_aligned_alloc(size_t(align), sz ? sz : 1, file, line);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new(size_t sz) {
+    return m61_new(sz, M61_SITE);
+}
+
+void* operator new[](size_t sz) {
+    return m61_new(sz, M61_SITE);
+}
+
+void* operator new(size_t sz, const std::nothrow_t&) noexcept {
+    return m61_malloc(sz ? sz : 1, M61_SITE);
+}
+
+void* operator new[](size_t sz, const std::nothrow_t&) noexcept {
+    return m61_malloc(sz ? sz : 1, M61_SITE);
+}
+
+void* operator new(size_t sz, std::align_val_t align) {
+    return m61_new_aligned(sz, align, M61_SITE);
+}
+
+void* operator new[](size_t sz, std::align_val_t align) {
+    return m61_new_aligned(sz, align, M61_SITE);
+}
+
+void* operator new(size_t sz, std::align_val_t align, const std::nothrow_t&) noexcept {
+    return m61_aligned_alloc(size_t(align), sz ? sz : 1, M61_SITE);
+}
+
+void* operator new[](size_t sz, std::align_val_t align, const std::nothrow_t&) noexcept {
+    return m61_aligned_alloc(size_t(align), sz ? sz : 1, M61_SITE);
+}
+
+void operator delete(void* ptr) noexcept {
+    m61_free(ptr, M61_SITE);
+}
+
+void operator delete[](void* ptr) noexcept {
+    m61_free(ptr, M61_SITE);
+}
+
+void operator delete(void* ptr, size_t sz) noexcept {
+    m61_free_sized(ptr, sz ? sz : 1, M61_SITE);
+}
+
+void operator delete[](void* ptr, size_t sz) noexcept {
+    m61_free_sized(ptr, sz ? sz : 1, M61_SITE);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    m61_free(ptr, M61_SITE);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+    m61_free(ptr, M61_SITE);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    m61_free(ptr, M61_SITE);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+    m61_free(ptr, M61_SITE);
+}
+
+void operator delete(void* ptr, size_t sz, std::align_val_t) noexcept {
+    m61_free_sized(ptr, sz ? sz : 1, M61_SITE);
+}
+
+void operator delete[](void* ptr, size_t sz, std::align_val_t) noexcept {
+    m61_free_sized(ptr, sz ? sz : 1, M61_SITE);
+}
+
+
+// Apply options and start a trace at startup, and write reports at
+// exit, if asked. Standard error is duplicated at startup because many
+// programs close it on their way out.
+
+static pid_t report_pid;                // process that reports, or 0
+static int report_fd = -1;              // if reporting to standard error
+static char report_filename[PATH_MAX];  // otherwise
+
+// m61_remove_env(name)
+//    Remove `name` from the environment. This edits `environ` directly
+//    rather than calling unsetenv, which bash, for one, replaces with a
+//    version that ignores the environment the shell was started with.
+
+static void m61_remove_env(const char* name) {
+    size_t len = strlen(name);
+    for (char** ep = environ; *ep; ) {
+        if (strncmp(*ep, name, len) == 0 && (*ep)[len] == '=') {
+            for (char** dp = ep; (dp[0] = dp[1]); ++dp) {
+            }
+        } else {
+            ++ep;
+        }
+    }
+}
+
+__attribute__((constructor)) static void m61_preload_init() {
+    if (const char* q = getenv("M61_QUARANTINE")) {
+        m61_options opts = m61_get_options();
+        opts.quarantine_bytes = strtoull(q, nullptr, 0);
+        m61_set_options(opts);
+    }
+    if (const char* t = getenv("M61_TRUST_SIZED_FREE")) {
+        m61_options opts = m61_get_options();
+        opts.trust_sized_free = strcmp(t, "1") == 0;
+        m61_set_options(opts);
+    }
+    if (const char* r = getenv("M61_REPORT")) {
+        if (strcmp(r, "1") == 0) {
+            report_fd = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 3);
+        } else {
+            m61_expand_pid(report_filename, sizeof(report_filename), r);
+        }
+        report_pid = getpid();
+        m61_remove_env("M61_REPORT");
+    }
+    if (const char* pattern = getenv("M61_TRACE")) {
+        char filename[PATH_MAX];
+        m61_expand_pid(filename, sizeof(filename), pattern);
+        m61_trace_start(filename);
+    }
+}
+
+__attribute__((destructor)) static void m61_preload_report() {
+    m61_trace_stop();
+    if (report_pid == 0 || report_pid != getpid()) {
+        return;
+    }
+    int fd = report_fd;
+    if (fd < 0 && report_filename[0]) {
+        fd = open(report_filename, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+    }
+    if (fd >= 0) {
+        m61_write_report(fd, 10);
+        close(fd);
+    }
+}
@@ -0,0 +1,233 @@
+#include "m61.hh"
+#include "m61trace.hh"
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <unistd.h>
+
+// m61replay: re-execute an allocation trace against m61 and report how
+// the allocator did.
+//
+//     m61replay [-s SAMPLE] TRACEFILE
+//
+// Traces come from `m61_trace_start`, or from any program run with
+// `M61_TRACE=FILE LD_PRELOAD=./libm61.so`. Operations are replayed in
+// the recorded order on one thread, with the recorded sizes and sites;
+// each trace pointer is mapped to the pointer the replay got for it.
+// New memory is touched, outside the timed region, so it is resident.
+// Allocations that failed when traced are skipped. The heap's resident
+// size is sampled, outside the timed region, every SAMPLE operations
+// (default 1024) and whenever live bytes pass the last sampled peak by
+// an eighth.
+//
+// The report gives throughput, per-operation latency percentiles, the
+// peak of live bytes, and fragmentation at that peak: the fraction of
+// resident heap memory not holding live data.
+
+using clock_type = std::chrono::steady_clock;
+
+struct replay_site {
+    std::string file;
+    int line = 0;
+};
+
+static const char* op_names[] = {
+    "malloc", "calloc", "realloc", "aligned_alloc", "free"
+};
+
+static void usage() {
+    fprintf(stderr, "Usage: m61replay [-s SAMPLE] TRACEFILE\n");
+    exit(1);
+}
+
+// percentile(v, p)
+//    Return the `p`th percentile of sorted vector `v`.
+
+static unsigned long long percentile(const std::vector<unsigned>& v, double p) {
+    if (v.empty()) {
+        return 0;
+    }
+    size_t i = size_t(p / 100 * (v.size() - 1) + 0.5);
+    return v[i];
+}
+
+int main(int argc, char** argv) {
+    size_t sample = 1024;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:")) != -1) {
+        if (opt == 's') {
+            sample = strtoul(optarg, nullptr, 0);
+        } else {
+            usage();
+        }
+    }
+    if (optind + 1 != argc || sample == 0) {
+        usage();
+    }
+
+    FILE* f = fopen(argv[optind], "rb");
+    if (!f) {
+        fprintf(stderr, "%s: %s\n", argv[optind], strerror(errno));
+        exit(1);
+    }
+    m61_trace_header hdr;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1
+        || memcmp(hdr.magic, M61_TRACE_MAGIC, sizeof(hdr.magic)) != 0
+        || hdr.record_size != sizeof(m61_trace_record)) {
+        fprintf(stderr, "%s: not an m61 trace\n", argv[optind]);
+        exit(1);
+    }
+
+    // Load the whole trace first, so reading it is not timed
+    std::vector<m61_trace_record> ops;
+    std::vector<replay_site> sites;
+    std::vector<unsigned> threads;
+    size_t nsites = 0;
+    m61_trace_record r;
+    while (fread(&r, sizeof(r), 1, f) == 1) {
+        if (r.op == M61_TRACE_SITE) {
+            if (sites.size() <= r.site) {
+                sites.resize(r.site + 1);
+            }
+            ++nsites;
+            replay_site& s = sites[r.site];
+            s.line = r.arg;
+            size_t padded = (r.size + sizeof(r) - 1) / sizeof(r) * sizeof(r);
+            std::vector<char> name(padded);
+            if (fread(name.data(), 1, padded, f) != padded) {
+                break;
+            }
+            s.file.assign(name.data(), r.size);
+        } else if (r.op < M61_TRACE_SITE) {
+            ops.push_back(r);
+            if (std::find(threads.begin(), threads.end(), r.thread) == threads.end()) {
+                threads.push_back(r.thread);
+            }
+        }
+    }
+    fclose(f);
+    replay_site unknown{"(unknown)", 0};
+
+    std::unordered_map<uint64_t, std::pair<void*, size_t>> live;
+    live.reserve(ops.size());
+    std::vector<unsigned> latency[M61_TRACE_SITE];
+    unsigned long long live_bytes = 0, peak_bytes = 0, sampled_bytes = 0;
+    unsigned long long peak_rss = 0, rss_at_peak = 0;
+    size_t nskipped = 0, nunknown = 0;
+    clock_type::duration elapsed{0};
+
+    for (size_t i = 0; i != ops.size(); ++i) {
+        const m61_trace_record& op = ops[i];
+        const replay_site& s = op.site < sites.size() ? sites[op.site] : unknown;
+        const char* file = s.file.c_str();
+        int line = s.line;
+
+        // Look up the block being freed or resized
+        uint64_t old_key = op.op == M61_TRACE_FREE ? op.ptr
+            : op.op == M61_TRACE_REALLOC ? op.arg : 0;
+        void* old_ptr = nullptr;
+        size_t old_size = 0;
+        if (old_key) {
+            auto it = live.find(old_key);
+            if (it == live.end()) {
+                // freed memory allocated before the trace started
+                ++nunknown;
+                continue;
+            }
+            old_ptr = it->second.first;
+            old_size = it->second.second;
+        }
+        if (op.op != M61_TRACE_FREE && op.ptr == 0
+            && !(op.op == M61_TRACE_REALLOC && op.size == 0 && old_ptr)) {
+            ++nskipped;
+            continue;
+        }
+
+        void* ptr = nullptr;
+        auto t0 = clock_type::now();
+        switch (op.op) {
+        case M61_TRACE_MALLOC:
+            ptr = m61_malloc(op.size, file, line);
+            break;
+        case M61_TRACE_CALLOC:
+            ptr = m61_calloc(op.arg, op.arg ? op.size / op.arg : 0, file, line);
+            break;
+        case M61_TRACE_REALLOC:
+            ptr = m61_realloc(old_ptr, op.size, file, line);
+            break;
+        case M61_TRACE_ALIGNED:
+            ptr = m61_aligned_alloc(op.arg, op.size, file, line);
+            break;
+        case M61_TRACE_FREE:
+            m61_free(old_ptr, file, line);
+            break;
+        }
+        auto t1 = clock_type::now();
+        elapsed += t1 - t0;
+        latency[op.op].push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+
+        if (old_key && (op.op == M61_TRACE_FREE || ptr || op.size == 0)) {
+            live.erase(old_key);
+            live_bytes -= old_size;
+        }
+        if (ptr) {
+            // touch the new memory, as the traced program presumably did
+            for (size_t off = old_size; off < op.size; off += 4096) {
+                static_cast<volatile char*>(ptr)[off] = 0;
+            }
+            live[op.ptr] = {ptr, op.size};
+            live_bytes += op.size;
+        } else if (op.op != M61_TRACE_FREE && op.size != 0) {
+            fprintf(stderr, "m61replay: operation %zu: %s of %zu bytes failed\n",
+                    i, op_names[op.op], size_t(op.size));
+        }
+
+        peak_bytes = std::max(peak_bytes, live_bytes);
+        if ((i + 1) % sample == 0
+            || (live_bytes == peak_bytes && live_bytes > sampled_bytes + sampled_bytes / 8)) {
+            unsigned long long rss = m61_get_statistics().heap_rss;
+            peak_rss = std::max(peak_rss, rss);
+            if (live_bytes >= sampled_bytes) {
+                sampled_bytes = live_bytes;
+                rss_at_peak = rss;
+            }
+        }
+    }
+
+    double secs = std::chrono::duration<double>(elapsed).count();
+    size_t nops = ops.size() - nskipped - nunknown;
+    printf("trace: %zu operations, %zu threads, %zu sites\n",
+           ops.size(), threads.size(), nsites);
+    if (nskipped || nunknown) {
+        printf("skipped: %zu failed when traced, %zu frees of untraced memory\n",
+               nskipped, nunknown);
+    }
+    printf("time: %zu operations in %.3f ms, %.0f ops/sec\n",
+           nops, secs * 1000, secs > 0 ? nops / secs : 0.0);
+    printf("%-14s %10s %8s %8s %8s %8s %8s\n",
+           "latency (ns)", "count", "p50", "p90", "p99", "p99.9", "max");
+    for (int o = 0; o != M61_TRACE_SITE; ++o) {
+        std::vector<unsigned>& v = latency[o];
+        if (v.empty()) {
+            continue;
+        }
+        std::sort(v.begin(), v.end());
+        printf("%-14s %10zu %8llu %8llu %8llu %8llu %8llu\n",
+               op_names[o], v.size(), percentile(v, 50), percentile(v, 90),
+               percentile(v, 99), percentile(v, 99.9), percentile(v, 100));
+    }
+    printf("peak live: %llu bytes\n", peak_bytes);
+    printf("peak resident heap: %llu bytes\n", peak_rss);
+    if (rss_at_peak > 0) {
+        printf("fragmentation at peak: %.1f%% (%llu live of %llu resident bytes)\n",
+               100.0 * (1.0 - double(std::min(sampled_bytes, rss_at_peak)) / rss_at_peak),
+               sampled_bytes, rss_at_peak);
+    }
+    m61_statistics stats = m61_get_statistics();
+    printf("heap span: %llu bytes\n",
+           stats.heap_max >= stats.heap_min ? (unsigned long long) (stats.heap_max - stats.heap_min) : 0ULL);
+}
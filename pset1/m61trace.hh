@@ -0,0 +1,47 @@
+#ifndef M61TRACE_HH
+#define M61TRACE_HH 1
+#include <cinttypes>
+
+// Allocation traces, written by `m61_trace_start` and read by `m61replay`.
+//
+// A trace file is an `m61_trace_header` followed by `m61_trace_record`s
+// in the order the operations happened. Allocations are recorded after
+// they return and frees before they start, so an address is always
+// allocated before it is freed and freed before it is handed out again.
+//
+// Each allocation site is announced by an M61_TRACE_SITE record the
+// first time it appears. That record's `size` is the length of the
+// site's file name, whose bytes follow it, padded with zeros to a
+// multiple of `sizeof(m61_trace_record)`.
+
+struct m61_trace_header {
+    char magic[8];                      // M61_TRACE_MAGIC
+    uint32_t record_size;               // sizeof(m61_trace_record)
+    uint32_t reserved;
+};
+
+static constexpr char M61_TRACE_MAGIC[8] = "M61TRC1";
+
+enum m61_trace_op {
+    M61_TRACE_MALLOC,                   // m61_malloc(size)
+    M61_TRACE_CALLOC,                   // m61_calloc(arg, size / arg)
+    M61_TRACE_REALLOC,                  // m61_realloc(arg, size)
+    M61_TRACE_ALIGNED,                  // m61_aligned_alloc(arg, size)
+    M61_TRACE_FREE,                     // m61_free(ptr) or m61_free_sized
+    M61_TRACE_SITE                      // `site` is file name, line `arg`
+};
+
+struct m61_trace_record {
+    uint64_t time;                      // ns since the trace started
+    uint64_t ptr;                       // pointer returned or freed;
+                                        // 0 if the allocation failed
+    uint64_t size;                      // bytes requested
+    uint64_t arg;                       // see `m61_trace_op`
+    uint32_t thread;                    // thread number, from 1
+    uint32_t site : 28;                 // site number
+    uint32_t op : 4;                    // an `m61_trace_op`
+};
+
+static_assert(sizeof(m61_trace_record) == 40, "trace records are packed");
+
+#endif
@@ -0,0 +1,55 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+#include <thread>
+// Check that m61 is thread-safe, including frees from other threads.
+
+constexpr int nthreads = 4;
+constexpr int nptrs = 1000;
+char* ptrs[nthreads][nptrs];
+
+void allocate(int t) {
+    for (int i = 0; i != nptrs; ++i) {
+        ptrs[t][i] = (char*) m61_malloc(1 + (i * 37 + t) % 200);
+        assert(ptrs[t][i]);
+        memset(ptrs[t][i], t, 1 + (i * 37 + t) % 200);
+    }
+}
+
+void churn_and_free(int t) {
+    // free the blocks allocated by the next thread over
+    int other = (t + 1) % nthreads;
+    for (int round = 0; round != 10; ++round) {
+        for (int i = 0; i != nptrs; ++i) {
+            void* p = m61_malloc(1 + (i * 13) % 300);
+            assert(p);
+            m61_free(p);
+        }
+    }
+    for (int i = 0; i != nptrs; ++i) {
+        assert(ptrs[other][i][0] == other);
+        m61_free(ptrs[other][i]);
+    }
+}
+
+int main() {
+    std::thread th[nthreads];
+    for (int t = 0; t != nthreads; ++t) {
+        th[t] = std::thread(allocate, t);
+    }
+    for (int t = 0; t != nthreads; ++t) {
+        th[t].join();
+    }
+    for (int t = 0; t != nthreads; ++t) {
+        th[t] = std::thread(churn_and_free, t);
+    }
+    for (int t = 0; t != nthreads; ++t) {
+        th[t].join();
+    }
+    m61_print_statistics();
+    m61_print_leak_report();
+}
+
+//! alloc count: active          0   total      44000   fail          0
+//! alloc size:  active          0   total        ???   fail          0
@@ -0,0 +1,52 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Check that the heap grows past 8 MiB of live data, and shrinks again.
+
+int main() {
+    // blocks below the mmap threshold, so they come from arenas
+    constexpr int nptrs = 160;
+    constexpr size_t sz = 100000;
+    assert(sz < m61_get_options().mmap_threshold);
+    char* ptrs[nptrs];
+    for (int i = 0; i != nptrs; ++i) {
+        ptrs[i] = (char*) m61_malloc(sz);
+        assert(ptrs[i]);
+        memset(ptrs[i], i, sz);
+    }
+
+    m61_statistics stat = m61_get_statistics();
+    bool beyond_first = false;
+    for (int i = 0; i != nptrs; ++i) {
+        assert(ptrs[i][0] == (char) i && ptrs[i][sz - 1] == (char) i);
+        assert((uintptr_t) ptrs[i] >= stat.heap_min);
+        assert((uintptr_t) ptrs[i] + sz - 1 <= stat.heap_max);
+        beyond_first = beyond_first
+            || (size_t) (ptrs[i] - ptrs[0]) >= (8 << 20);
+    }
+    // more than the first 8 MiB arena holds is resident
+    assert(beyond_first);
+    assert(stat.heap_rss >= nptrs * sz);
+
+    for (int i = 0; i != nptrs; ++i) {
+        m61_free(ptrs[i]);
+    }
+    // the extra arenas are unmapped, and the first is trimmed
+    assert(m61_get_heap_info().tail_bytes <= (8 << 20));
+    stat = m61_get_statistics();
+    assert(stat.heap_rss < (8 << 20));
+
+    // memory is reusable after the extra arenas are gone
+    for (int i = 0; i != nptrs; ++i) {
+        ptrs[i] = (char*) m61_malloc(sz);
+        assert(ptrs[i]);
+    }
+    for (int i = 0; i != nptrs; ++i) {
+        m61_free(ptrs[i]);
+    }
+    m61_print_statistics();
+}
+
+//! alloc count: active          0   total        320   fail          0
+//! alloc size:  active          0   total   32000000   fail          0
@@ -0,0 +1,19 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Check detection of boundary write errors in a large allocation.
+
+int main() {
+    size_t sz = m61_get_options().mmap_threshold + 1000;
+    char* ptr = (char*) m61_malloc(sz);
+    fprintf(stderr, "Will free %p\n", ptr);
+    memset(ptr, 'A', sz + 1);
+    m61_free(ptr);
+    m61_print_statistics();
+}
+
+//! Will free ??{0x\w+}=ptr??
+//! MEMORY BUG???: detected wild write during free of pointer ??ptr??
+//! ???
+//!!ABORT
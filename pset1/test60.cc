@@ -0,0 +1,33 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Check that the large-allocation threshold can be changed, and that
+// large allocations appear in statistics and the leak report.
+
+int main() {
+    m61_options opts = m61_get_options();
+    opts.mmap_threshold = 4000;
+    m61_set_options(opts);
+
+    char* small = (char*) m61_malloc(3999);
+    char* large = (char*) m61_malloc(4000);
+    char* larger = (char*) m61_malloc(100000);
+    memset(large, 1, 4000);
+    memset(larger, 2, 100000);
+    m61_free(larger);
+
+    m61_statistics stat = m61_get_statistics();
+    assert((uintptr_t) large >= stat.heap_min);
+    assert((uintptr_t) large + 3999 <= stat.heap_max);
+    (void) small;
+
+    m61_print_statistics();
+    m61_print_leak_report();
+}
+
+//!!UNORDERED
+//! alloc count: active          2   total          3   fail          0
+//! alloc size:  active       7999   total     107999   fail          0
+//! LEAK CHECK: test???.cc:13: allocated object ??{\w+}?? with size 3999
+//! LEAK CHECK: test???.cc:14: allocated object ??{\w+}?? with size 4000
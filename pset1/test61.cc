@@ -0,0 +1,52 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Check m61_realloc: contents are preserved, and blocks grow and shrink in
+// place when they can.
+
+static bool all(const char* p, char ch, size_t n) {
+    for (size_t i = 0; i != n; ++i) {
+        if (p[i] != ch) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main() {
+    char* p = (char*) m61_malloc(100);
+    memset(p, 'a', 100);
+    // nothing follows `p`, so it grows in place
+    char* q = (char*) m61_realloc(p, 1000);
+    assert(q == p && all(q, 'a', 100));
+    memset(q, 'b', 1000);
+
+    // now something follows it, so it moves
+    char* r = (char*) m61_malloc(10);
+    char* s = (char*) m61_realloc(q, 5000);
+    assert(s && s != q && all(s, 'b', 1000));
+
+    // shrinking never moves
+    char* t = (char*) m61_realloc(s, 50);
+    assert(t == s && all(t, 'b', 50));
+
+    char* u = (char*) m61_realloc(nullptr, 10);
+    assert(u);
+    assert(m61_realloc(t, 0) == nullptr);
+
+    // large blocks
+    char* big = (char*) m61_realloc(nullptr, 1 << 20);
+    memset(big, 'c', 1 << 20);
+    big = (char*) m61_realloc(big, 8 << 20);
+    assert(big && all(big, 'c', 1 << 20));
+    memset(big, 'd', 8 << 20);
+
+    m61_free(big);
+    m61_free(r);
+    m61_free(u);
+    m61_print_statistics();
+}
+
+//! alloc count: active          0   total          8   fail          0
+//! alloc size:  active          0   total    9443354   fail          0
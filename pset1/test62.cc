@@ -0,0 +1,52 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+#include <vector>
+// Check m61_aligned_alloc and over-aligned types in m61_allocator.
+
+struct alignas(64) vec16 {
+    float x[16];
+};
+
+int main() {
+    // every allocation is 16-byte aligned
+    for (size_t sz = 1; sz != 100; ++sz) {
+        void* p = m61_malloc(sz);
+        assert((uintptr_t) p % 16 == 0);
+        m61_free(p);
+    }
+
+    // arena and mapped blocks honor any power-of-two alignment
+    void* ptrs[2][8];
+    for (int large = 0; large != 2; ++large) {
+        for (int i = 0; i != 8; ++i) {
+            size_t align = size_t(32) << (2 * i);
+            size_t sz = large ? 200000 : 100 + i;
+            ptrs[large][i] = m61_aligned_alloc(align, sz);
+            assert(ptrs[large][i] && (uintptr_t) ptrs[large][i] % align == 0);
+            memset(ptrs[large][i], 'x', sz);
+        }
+    }
+    for (int large = 0; large != 2; ++large) {
+        for (int i = 0; i != 8; ++i) {
+            m61_free(ptrs[large][i]);
+        }
+    }
+
+    // invalid alignments fail
+    assert(!m61_aligned_alloc(48, 100));
+    assert(!m61_aligned_alloc(0, 100));
+
+    {
+        std::vector<vec16, m61_allocator<vec16>> v;
+        for (int i = 0; i != 100; ++i) {
+            v.push_back(vec16{});
+            assert((uintptr_t) v.data() % 64 == 0);
+        }
+    }
+    m61_print_statistics();
+}
+
+//! alloc count: active          0   total    ??{\d+}??   fail          2
+//! alloc size:  active          0   total    ??{\d+}??   fail        200
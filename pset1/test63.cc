@@ -0,0 +1,30 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Check the allocation-site report.
+
+int main() {
+    void* ptrs[10];
+    for (int i = 0; i != 10; ++i) {
+        ptrs[i] = m61_malloc(100, "churn.cc", 10);
+        m61_free(ptrs[i]);
+    }
+    for (int i = 0; i != 10; ++i) {
+        ptrs[i] = m61_malloc(50, "hold.cc", 20);
+    }
+    for (int i = 0; i != 5; ++i) {
+        m61_free(ptrs[i]);
+    }
+    void* p = m61_malloc(1, "tiny.cc", 30);
+    p = m61_realloc(p, 10, "grow.cc", 40);
+    m61_free(p);
+    for (int i = 5; i != 10; ++i) {
+        m61_free(ptrs[i]);
+    }
+    m61_print_site_report(3);
+}
+
+//! SITE: churn.cc:10: 10 allocations, 1000 bytes, 0 active bytes, 100 peak active bytes
+//! SITE: hold.cc:20: 10 allocations, 500 bytes, 0 active bytes, 500 peak active bytes
+//! SITE: grow.cc:40: 1 allocations, 10 bytes, 0 active bytes, 10 peak active bytes
@@ -0,0 +1,44 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Check that m61_calloc returns zeroed memory under every scrub policy.
+
+static bool zero(const char* p, size_t n) {
+    for (size_t i = 0; i != n; ++i) {
+        if (p[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main() {
+    m61_scrub_policy policies[] = {M61_SCRUB_OFF, M61_SCRUB_ON, M61_SCRUB_DEFERRED};
+    for (m61_scrub_policy policy : policies) {
+        m61_options opts = m61_get_options();
+        opts.scrub = policy;
+        m61_set_options(opts);
+
+        char* ptrs[500];
+        for (int round = 0; round != 3; ++round) {
+            for (int i = 0; i != 500; ++i) {
+                size_t sz = 1 + (i * 37) % 2000;
+                ptrs[i] = (char*) m61_calloc(sz, 1);
+                assert(ptrs[i] && zero(ptrs[i], sz));
+                memset(ptrs[i], 'x', sz);
+            }
+            for (int i = 0; i < 500; i += 1 + round) {
+                m61_free(ptrs[i]);
+                ptrs[i] = nullptr;
+            }
+            for (int i = 0; i != 500; ++i) {
+                m61_free(ptrs[i]);
+            }
+        }
+    }
+    m61_print_statistics();
+}
+
+//! alloc count: active          0   total       4500   fail          0
+//! alloc size:  active          0   total    ??{\d+}??   fail          0
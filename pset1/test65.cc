@@ -0,0 +1,49 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+#include <vector>
+// Check m61 arenas and the memory_resource adapter.
+
+int main() {
+    m61_arena* a = m61_arena_create();
+    for (int round = 0; round != 3; ++round) {
+        char* ptrs[300];
+        for (int i = 0; i != 300; ++i) {
+            size_t sz = 1 + (i * 53) % 700;
+            ptrs[i] = (char*) m61_arena_alloc(a, sz, i % 5 == 0 ? 64 : 16);
+            assert(ptrs[i] && (uintptr_t) ptrs[i] % (i % 5 == 0 ? 64 : 16) == 0);
+            memset(ptrs[i], i, sz);
+        }
+        // a big allocation gets a chunk of its own
+        char* big = (char*) m61_arena_alloc(a, 300000);
+        memset(big, 'b', 300000);
+        for (int i = 0; i != 300; ++i) {
+            size_t sz = 1 + (i * 53) % 700;
+            assert(ptrs[i][0] == (char) i && ptrs[i][sz - 1] == (char) i);
+        }
+        if (round == 2) {
+            m61_print_statistics();
+            m61_print_leak_report();
+        }
+        m61_arena_reset(a);
+    }
+
+    {
+        m61_memory_resource resource(a);
+        std::pmr::vector<int> v(&resource);
+        for (int i = 0; i != 1000; ++i) {
+            v.push_back(i);
+        }
+        assert(v[999] == 999);
+    }
+    m61_arena_destroy(a);
+    m61_print_statistics();
+    m61_print_leak_report();
+}
+
+//! alloc count: active        301   total        903   fail          0
+//! alloc size:  active     404450   total    1213350   fail          0
+//! LEAK CHECK: test65.cc:9: arena ??{0x\w+}=arena?? holds 301 objects with size 404450
+//! alloc count: active          0   total        ??{\d+}??   fail          0
+//! alloc size:  active          0   total    ??{\d+}??   fail          0
@@ -0,0 +1,16 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Check that m61_free_sized catches a wrong size.
+
+int main() {
+    void* ptr = m61_malloc(100);
+    m61_free_sized(ptr, 100);
+    ptr = m61_malloc(200);
+    m61_free_sized(ptr, 100);
+    m61_print_statistics();
+}
+
+//! MEMORY BUG: test???.cc:11: invalid free of pointer ???, wrong size 100 (allocated with size 200)
+//!!ABORT
@@ -0,0 +1,50 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Check m61_pool: slots are aligned, distinct, and reused.
+
+struct alignas(32) node {
+    int value;
+    node* next;
+    node(int v, node* n)
+        : value(v), next(n) {
+    }
+};
+
+int main() {
+    {
+        m61_pool<node> pool;
+        node* list = nullptr;
+        for (int i = 0; i != 5000; ++i) {
+            list = pool.create(i, list);
+            assert((uintptr_t) list % 32 == 0);
+        }
+        int n = 4999;
+        for (node* x = list; x; x = x->next, --n) {
+            assert(x->value == n);
+        }
+
+        // free the first half; new objects reuse their slots
+        node* freed = nullptr;
+        for (int i = 0; i != 2500; ++i) {
+            node* next = list->next;
+            freed = list;
+            pool.destroy(list);
+            list = next;
+        }
+        node* again = pool.create(0, nullptr);
+        assert(again == freed);
+        pool.destroy(again);
+
+        m61_print_statistics();
+        m61_print_leak_report();
+    }
+    m61_print_statistics();
+}
+
+//! alloc count: active       2500   total       5001   fail          0
+//! alloc size:  active      80000   total     160032   fail          0
+//! LEAK CHECK: test67.cc:17: pool ??{0x\w+}=pool?? holds 2500 objects with size 32
+//! alloc count: active          0   total       5001   fail          0
+//! alloc size:  active          0   total     160032   fail          0
@@ -0,0 +1,34 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Check that small blocks parked without coalescing are coalesced before
+// a large request is served.
+
+int main() {
+    char* ptrs[1000];
+    for (int i = 0; i != 1000; ++i) {
+        ptrs[i] = (char*) m61_malloc(64);
+    }
+    // keep the frontier out of reach
+    char* fence = (char*) m61_malloc(64);
+    uintptr_t end = m61_get_statistics().heap_max;
+    for (int i = 999; i >= 0; --i) {
+        m61_free(ptrs[i]);
+    }
+
+    // a block of the same size comes straight back
+    char* p = (char*) m61_malloc(64);
+    m61_free(p);
+
+    // the freed blocks coalesce, so this fits below `fence`
+    char* big = (char*) m61_malloc(100000);
+    assert(big >= ptrs[0] && big < fence);
+    assert(m61_get_statistics().heap_max == end);
+    m61_free(big);
+    m61_free(fence);
+    m61_print_statistics();
+}
+
+//! alloc count: active          0   total       1003   fail          0
+//! alloc size:  active          0   total     164128   fail          0
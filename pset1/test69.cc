@@ -0,0 +1,70 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Check that freed memory is returned to the OS.
+
+int main() {
+    // with scrubbing, freed memory reads as zero whether or not it was
+    // trimmed
+    m61_options opts = m61_get_options();
+    opts.scrub = M61_SCRUB_OFF;
+    m61_set_options(opts);
+
+    unsigned long long rss0 = m61_get_statistics().heap_rss;
+
+    // 6 MiB of blocks in the arena, with a fence so nothing reaches the
+    // frontier
+    char* ptrs[96];
+    for (int i = 0; i != 96; ++i) {
+        ptrs[i] = (char*) m61_malloc(65536);
+        memset(ptrs[i], 'x', 65536);
+    }
+    char* fence = (char*) m61_malloc(10);
+    unsigned long long rss1 = m61_get_statistics().heap_rss;
+    assert(rss1 >= rss0 + (6 << 20));
+
+    // freeing coalesces the blocks into one range, whose pages go back
+    for (int i = 0; i != 96; ++i) {
+        m61_free(ptrs[i]);
+    }
+    unsigned long long rss2 = m61_get_statistics().heap_rss;
+    assert(rss2 < rss0 + (1 << 20));
+
+    // reusing the range (below the mmap threshold) reads zeroes from
+    // fresh pages past the first
+    char* p = (char*) m61_malloc(100000);
+    assert(p >= ptrs[0] && p < ptrs[95]);
+    for (int i = 4096; i != 100000; ++i) {
+        assert(p[i] == 0);
+    }
+    memset(p, 'y', 100000);
+    m61_free(p);
+
+    // the frontier's pages go back too
+    m61_free(fence);
+    for (int i = 0; i != 96; ++i) {
+        ptrs[i] = (char*) m61_malloc(65536);
+        memset(ptrs[i], 'x', 65536);
+    }
+    for (int i = 95; i >= 0; --i) {
+        m61_free(ptrs[i]);
+    }
+    assert(m61_get_statistics().heap_rss < rss0 + (1 << 20));
+
+    // with a huge threshold, nothing goes back
+    opts.trim_threshold = SIZE_MAX;
+    m61_set_options(opts);
+    for (int i = 0; i != 96; ++i) {
+        ptrs[i] = (char*) m61_malloc(65536);
+        memset(ptrs[i], 'x', 65536);
+    }
+    for (int i = 95; i >= 0; --i) {
+        m61_free(ptrs[i]);
+    }
+    assert(m61_get_statistics().heap_rss >= rss0 + (6 << 20));
+    m61_print_statistics();
+}
+
+//! alloc count: active          0   total        290   fail          0
+//! alloc size:  active          0   total   ??{\d+}??   fail          0
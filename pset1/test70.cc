@@ -0,0 +1,32 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Check that arenas can be aligned for transparent huge pages.
+
+int main() {
+    m61_options opts = m61_get_options();
+    opts.huge_pages = true;
+    m61_set_options(opts);
+
+    // the first block starts its arena, which is 2 MiB-aligned
+    char* first = (char*) m61_malloc(100);
+    assert((uintptr_t) first % (2 << 20) == 32 % (2 << 20));
+
+    char* ptrs[64];
+    for (int i = 0; i != 64; ++i) {
+        ptrs[i] = (char*) m61_malloc(100000);
+        memset(ptrs[i], 'x', 100000);
+    }
+    // huge pages may be unavailable, but they are never more than the heap
+    m61_statistics stats = m61_get_statistics();
+    assert(stats.heap_huge <= stats.heap_rss);
+    for (int i = 0; i != 64; ++i) {
+        m61_free(ptrs[i]);
+    }
+    m61_free(first);
+    m61_print_statistics();
+}
+
+//! alloc count: active          0   total         65   fail          0
+//! alloc size:  active          0   total    6400100   fail          0
@@ -0,0 +1,81 @@
+#include "m61.hh"
+#include "m61trace.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+#include <unistd.h>
+// Check that allocation traces record each operation and announce sites.
+
+int main() {
+    char filename[] = "/tmp/m61trace.XXXXXX";
+    int fd = mkstemp(filename);
+    assert(fd >= 0);
+    close(fd);
+
+    void* untraced = m61_malloc(10, "before.cc", 1);
+    bool ok = m61_trace_start(filename);
+    assert(ok);
+    void* a = m61_malloc(100, "alpha.cc", 10);
+    void* b = m61_calloc(4, 25, "beta.cc", 20);
+    a = m61_realloc(a, 200, "alpha.cc", 11);
+    void* c = m61_aligned_alloc(256, 64, "alpha.cc", 10);
+    m61_free(b, "beta.cc", 21);
+    m61_free_sized(c, 64, "gamma.cc", 30);
+    m61_free(a, "gamma.cc", 30);
+    m61_trace_stop();
+    m61_free(untraced);
+
+    FILE* f = fopen(filename, "rb");
+    assert(f);
+    m61_trace_header hdr;
+    size_t n = fread(&hdr, sizeof(hdr), 1, f);
+    assert(n == 1 && memcmp(hdr.magic, M61_TRACE_MAGIC, 8) == 0);
+    static const char* names[] = {
+        "malloc", "calloc", "realloc", "aligned_alloc", "free", "site"
+    };
+    uint64_t ptrs[4] = {0, 0, 0, 0};
+    uint64_t last_time = 0;
+    m61_trace_record r;
+    while (fread(&r, sizeof(r), 1, f) == 1) {
+        assert(r.time >= last_time && r.thread == 1);
+        last_time = r.time;
+        if (r.op == M61_TRACE_SITE) {
+            char name[sizeof(r)];
+            n = fread(name, sizeof(r), 1, f);
+            assert(n == 1 && r.size < sizeof(r));
+            printf("site %u: %s:%d\n", r.site, name, int(r.arg));
+            continue;
+        }
+        // show pointers as "#N", in order of first appearance
+        uint64_t ptr = r.op == M61_TRACE_REALLOC ? r.arg : r.ptr;
+        int id = 0;
+        while (ptrs[id] && ptrs[id] != ptr) {
+            ++id;
+        }
+        ptrs[id] = ptr;
+        printf("%s %zu arg %zu ptr #%d site %u\n", names[r.op],
+               size_t(r.size), r.op == M61_TRACE_REALLOC ? 0 : size_t(r.arg),
+               id, r.site);
+        if (r.op == M61_TRACE_REALLOC) {
+            ptrs[id] = r.ptr;
+        }
+    }
+    fclose(f);
+    unlink(filename);
+    m61_print_statistics();
+}
+
+//! site ??{\d+}=alpha10??: alpha.cc:10
+//! malloc 100 arg 0 ptr #0 site ??alpha10??
+//! site ??{\d+}=beta20??: beta.cc:20
+//! calloc 100 arg 4 ptr #1 site ??beta20??
+//! site ??{\d+}=alpha11??: alpha.cc:11
+//! realloc 200 arg 0 ptr #0 site ??alpha11??
+//! aligned_alloc 64 arg 256 ptr #2 site ??alpha10??
+//! site ??{\d+}=beta21??: beta.cc:21
+//! free 100 arg 0 ptr #1 site ??beta21??
+//! site ??{\d+}=gamma30??: gamma.cc:30
+//! free 64 arg 0 ptr #2 site ??gamma30??
+//! free 200 arg 0 ptr #0 site ??gamma30??
+//! alloc count: active          0   total          5   fail          0
+//! alloc size:  active          0   total        474   fail          0
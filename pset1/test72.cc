@@ -0,0 +1,51 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Check m61_get_heap_info's free-space accounting.
+
+static void print_info(const char* when) {
+    m61_heap_info info = m61_get_heap_info();
+    printf("%s: %zu free blocks, %zu free bytes, largest %zu, tail %zu, fragmentation %.2f\n",
+           when, info.free_blocks, info.free_bytes, info.largest_free,
+           info.tail_bytes, info.fragmentation);
+}
+
+int main() {
+    // blocks of at least 1 KiB skip the thread cache and fast bins
+    void* a = m61_malloc(2000);
+    void* b = m61_malloc(1500);
+    void* c = m61_malloc(4000);
+    void* d = m61_malloc(1500);
+    print_info("start");
+
+    // two holes, separated by `b`
+    m61_free(a);
+    m61_free(c);
+    print_info("holes");
+
+    // too big for either hole, so it comes from the tail
+    void* e = m61_malloc(5000);
+    print_info("tail");
+
+    // best fit splits the smaller hole
+    void* f = m61_malloc(1000);
+    print_info("split");
+
+    m61_free(b);
+    print_info("merged");
+
+    m61_free(f);
+    m61_free(d);
+    m61_free(e);
+    print_info("empty");
+    m61_heap_info info = m61_get_heap_info();
+    assert(info.parked_blocks == 0 && info.parked_bytes == 0);
+}
+
+//! start: 0 free blocks, 0 free bytes, largest 0, tail 8379408, fragmentation 0.00
+//! holes: 2 free blocks, 6096 free bytes, largest 4048, tail 8379408, fragmentation 0.34
+//! tail: 2 free blocks, 6096 free bytes, largest 4048, tail 8374368, fragmentation 0.34
+//! split: 2 free blocks, 5056 free bytes, largest 4048, tail 8374368, fragmentation 0.20
+//! merged: 1 free blocks, 6608 free bytes, largest 6608, tail 8374368, fragmentation 0.00
+//! empty: 0 free blocks, 0 free bytes, largest 0, tail 8388608, fragmentation 0.00
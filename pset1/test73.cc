@@ -0,0 +1,26 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Check that the quarantine catches a write to freed memory when the
+// block leaves the quarantine.
+
+int main() {
+    m61_options opts = m61_get_options();
+    opts.quarantine_bytes = 16 << 10;
+    m61_set_options(opts);
+
+    char* p = (char*) m61_malloc(100);
+    m61_free(p);
+    p[8] = 'x';
+
+    // push `p` out of the quarantine
+    for (int i = 0; i != 32; ++i) {
+        m61_free(m61_malloc(1000));
+    }
+    m61_print_statistics();
+}
+
+//! MEMORY BUG???: detected use after free of pointer ???
+//! ???: ??? is 8 bytes inside a 100 byte region allocated here
+//!!ABORT
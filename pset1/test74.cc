@@ -0,0 +1,48 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Check that quarantined blocks are poisoned, are not reused until they
+// leave the quarantine, and come back out usable.
+
+int main() {
+    m61_options opts = m61_get_options();
+    opts.quarantine_bytes = 4 << 10;
+    opts.scrub = M61_SCRUB_OFF;
+    m61_set_options(opts);
+
+    // a freed block is poisoned and not handed out again at once
+    unsigned char* p = (unsigned char*) m61_malloc(64);
+    memset(p, 'a', 64);
+    m61_free(p);
+    assert(p[0] == 0xFD && p[63] == 0xFD);
+    void* q = m61_malloc(64);
+    assert(q != p);
+    m61_free(q);
+
+    // once enough is freed after it, it is reused, and calloc still
+    // clears the poison
+    bool reused = false;
+    for (int i = 0; i != 200 && !reused; ++i) {
+        unsigned char* r = (unsigned char*) m61_calloc(1, 64);
+        for (int j = 0; j != 64; ++j) {
+            assert(r[j] == 0);
+        }
+        reused = r == p;
+        m61_free(r);
+    }
+    assert(reused);
+
+    // turning the quarantine off releases its blocks
+    opts.quarantine_bytes = 0;
+    m61_set_options(opts);
+    void* s = m61_malloc(10000);
+    m61_free(s);
+    void* t = m61_malloc(10000);
+    assert(t == s);
+    m61_free(t);
+    m61_print_statistics();
+}
+
+//! alloc count: active          0   total        ???   fail          0
+//! alloc size:  active          0   total        ???   fail          0
@@ -0,0 +1,49 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Check that large requests take the best-fitting free block, that the
+// split remainder is binned, and that small requests find it through the
+// size class bitmap from a smaller class.
+
+int main() {
+    // three large free blocks, kept apart by in-use guards
+    char* a = (char*) m61_malloc(4000);
+    void* g1 = m61_malloc(100);
+    char* b = (char*) m61_malloc(2000);
+    void* g2 = m61_malloc(100);
+    char* c = (char*) m61_malloc(3000);
+    void* g3 = m61_malloc(100);
+    m61_free(a);
+    m61_free(b);
+    m61_free(c);
+
+    // the best fit is `b` for 1500 bytes and `c` for 2300, whatever the
+    // order the blocks were freed in
+    char* p = (char*) m61_malloc(1500);
+    assert(p == b);
+    char* q = (char*) m61_malloc(2300);
+    assert(q == c);
+
+    // the splits left small remainders right after `p` and `q`; a small
+    // request takes the smallest one that fits, even from a larger class
+    char* r = (char*) m61_malloc(200);
+    assert(r > p && r < g2);
+    char* s = (char*) m61_malloc(100);
+    assert(s > r && s < g2);
+    char* t = (char*) m61_malloc(300);
+    assert(t > q && t < g3);
+
+    // the untouched block is still whole
+    char* u = (char*) m61_malloc(4000);
+    assert(u == a);
+
+    for (void* ptr : {(void*) p, (void*) q, (void*) r, (void*) s, (void*) t,
+                      (void*) u, g1, g2, g3}) {
+        m61_free(ptr);
+    }
+    m61_print_statistics();
+}
+
+//! alloc count: active          0   total         12   fail          0
+//! alloc size:  active          0   total      17700   fail          0
@@ -0,0 +1,26 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Check that a freed block coalesces with free blocks on both sides.
+
+int main() {
+    char* a = (char*) m61_malloc(2000);
+    char* b = (char*) m61_malloc(2000);
+    char* c = (char*) m61_malloc(2000);
+    void* guard = m61_malloc(100);
+    m61_free(a);
+    m61_free(c);
+
+    // freeing `b` merges all three blocks, so a request none of them
+    // could serve alone fits where `a` was
+    m61_free(b);
+    char* p = (char*) m61_malloc(6000);
+    assert(p == a);
+    m61_free(p);
+    m61_free(guard);
+    m61_print_statistics();
+}
+
+//! alloc count: active          0   total          5   fail          0
+//! alloc size:  active          0   total      12100   fail          0
@@ -0,0 +1,21 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Check that free detects a block whose header was overwritten.
+
+int main() {
+    char* ptr = (char*) m61_malloc(100);
+    char* guard = (char*) m61_malloc(100);
+    fprintf(stderr, "Bad pointer %p\n", ptr);
+    // the header's last word, just before the payload, is its magic
+    ptr[-1] ^= 0x5A;
+    m61_free(ptr);
+    m61_free(guard);
+    m61_print_statistics();
+}
+
+//! Bad pointer ??{0x\w+}=ptr??
+//! MEMORY BUG???: invalid free of pointer ??ptr??, not allocated
+//! ???
+//!!ABORT
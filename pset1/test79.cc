@@ -0,0 +1,47 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Check that blocks flushed from the thread cache into an arena's frontier
+// are reused before a new arena is mapped.
+
+int main() {
+    constexpr size_t small_block = 944;         // block size of a 900-byte
+                                                // allocation
+    void* first = m61_malloc(100);
+
+    // fill the arena until exactly 8 small blocks and 1008 bytes are left
+    void* fill[100];
+    int nfill = 0;
+    while (m61_get_heap_info().tail_bytes >= 100048 + 16 * small_block) {
+        fill[nfill++] = m61_malloc(100000);
+    }
+    size_t tail = m61_get_heap_info().tail_bytes;
+    fill[nfill++] = m61_malloc(tail - 8 * small_block - 1008 - 40);
+    assert(m61_get_heap_info().tail_bytes == 8 * small_block + 1008);
+
+    // free 8 small blocks into the thread cache
+    char* small[8];
+    for (int i = 0; i != 8; ++i) {
+        small[i] = (char*) m61_malloc(900);
+    }
+    for (int i = 0; i != 8; ++i) {
+        m61_free(small[i]);
+    }
+
+    // only once they are flushed and merged into the frontier does this
+    // fit, and it fits without a new arena
+    void* p = m61_malloc(8 * small_block - 40);
+    assert(p == small[0]);
+    assert(m61_get_heap_info().tail_bytes == 1008);
+
+    m61_free(p);
+    for (int i = 0; i != nfill; ++i) {
+        m61_free(fill[i]);
+    }
+    m61_free(first);
+    m61_print_statistics();
+}
+
+//! alloc count: active          0   total        ???   fail          0
+//! alloc size:  active          0   total        ???   fail          0
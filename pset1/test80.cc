@@ -0,0 +1,34 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+#include <vector>
+// Check that m61_free_sized frees correctly when it trusts its caller.
+
+int main() {
+    m61_options opts = m61_get_options();
+    opts.trust_sized_free = true;
+    m61_set_options(opts);
+
+    void* small = m61_malloc(100);
+    void* large = m61_malloc(1 << 20);
+    m61_free_sized(small, 100);
+    m61_free_sized(large, 1 << 20);
+
+    // containers free through m61_free_sized
+    std::vector<int, m61_allocator<int>> v;
+    for (int i = 0; i != 1000; ++i) {
+        v.push_back(i);
+    }
+    v.clear();
+    v.shrink_to_fit();
+
+    // the freed memory is reused
+    void* again = m61_malloc(100);
+    assert(again == small);
+    m61_free(again);
+    m61_print_statistics();
+}
+
+//! alloc count: active          0   total        ???   fail          0
+//! alloc size:  active          0   total        ???   fail          0
@@ -443,7 +443,7 @@ sub add_make_targets ($) {
         push @t, $1;
     }
     foreach my $t (@t) {
-        next if $command !~ m/(?:\A|[|&;]\s*|'\|'\s*|\.\/socketpipe\s*(?:-B\s*\d+\s*|))$t/;
+        next if $command !~ m/(?:\A|[|&;]\s*|'\|'\s*|\.\/socketpipe\s*(?:-B\s*\d+\s*|))(?:[A-Z_][A-Z0-9_]*=\S*\s+)*$t/;
         $t = substr($t, 2);
         if (!exists($MAKE_TARGETS{$t})) {
             push @MAKE_TARGETS, $t;
@@ -1257,6 +1257,31 @@ enqueue("C20",
     "magic random file, byte I/O, sequential",
     "perf" => 0, "compare" => -1, "insize" => 400000, "check_random" => 1);
 
+enqueue("C21",
+    "./gathercat61 -b 3000 -o outputs/out.txt $textsm",
+    "vectored block I/O, sequential correctness",
+    "perf" => 0, "expect" => $textsm);
+
+enqueue("C22",
+    "cat $textsm | ./gathercat61 -b 3000 | cat > outputs/out.txt",
+    "vectored block I/O, piped, sequential correctness",
+    "perf" => 0, "expect" => $textsm);
+
+enqueue("C23",
+    "./slow-cat61 -D 0.01 $textsm | ./blockcat61 -b 1021 -y > outputs/out.txt",
+    "slow pipe, read-ahead, sequential correctness",
+    "perf" => 0, "expect" => $textsm);
+
+enqueue("C24",
+    "IO61_MMAP=0 ./randblockcat61 -b 40000 -o outputs/out.txt $textmd",
+    "unmapped file, 1B-40KB block I/O around the cache bypass size, sequential correctness",
+    "perf" => 0, "expect" => $textmd);
+
+enqueue("C25",
+    "cat $textmd | ./randblockcat61 -b 40000 | cat > outputs/out.txt",
+    "piped, 1B-40KB block I/O around the cache bypass size, sequential correctness",
+    "perf" => 0, "expect" => $textmd);
+
 
 # NONSEQUENTIAL CORRECTNESS
 enqueue("CN1",
@@ -1294,6 +1319,16 @@ enqueue("CN7",
     "magic random file, byte I/O, reverse order",
     "perf" => 0, "compare" => -1, "insize" => 500000, "check_random" => 1);
 
+enqueue("CN8",
+    "IO61_MMAP=0 ./stridecat61 -b 1024 -t 524288 -o outputs/out.txt $textmd",
+    "unmapped file, block cache eviction, strided reads",
+    "perf" => 0, "compare" => 1);
+
+enqueue("CN9",
+    "rm -f outputs/sparse; truncate -s 1073739776 outputs/sparse; cat $textweeny >> outputs/sparse; ./stridecat61 -s 4096 -b 4096 -p 1073739776 -o outputs/out.txt outputs/sparse; rm -f outputs/sparse",
+    "block I/O, read across the 1 GiB mapping window boundary",
+    "perf" => 0, "expect" => $textweeny);
+
 
 # REGULAR FILES, SEQUENTIAL I/O
 enqueue("MP1",
@@ -1333,6 +1368,10 @@ enqueue("MP9",
     "./blockcat61 -b 1024 $textmd | cat > outputs/out.txt",
     "mixed-piped medium file, 1KB block I/O, sequential");
 
+enqueue("MP10",
+    "./gathercat61 -b 256 -o outputs/out.txt $textmd",
+    "regular medium file, vectored 1B-256B block I/O, sequential");
+
 
 # NONSEQUENTIAL
 enqueue("MPN1",
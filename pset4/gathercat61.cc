@@ -0,0 +1,52 @@
+#include "io61.hh"
+
+// Usage: ./gathercat61 [-b MAXBLOCKSIZE] [-r RANDOMSEED] [-o OUTFILE] [FILE]
+//    Copies the input FILE to OUTFILE using vectored I/O. Each read
+//    scatters data into 16 buffers of random sizes between 1 and
+//    MAXBLOCKSIZE (which defaults to 4096) with io61_readv, and each
+//    write gathers the data read from those buffers with io61_writev.
+
+int main(int argc, char* argv[]) {
+    // Parse arguments
+    io61_args args = io61_args("b:r:o:i:", 4096).set_seed(83419)
+        .parse(argc, argv);
+
+    // Allocate buffers, open files
+    const int nbufs = 16;
+    unsigned char* buf = new unsigned char[nbufs * args.block_size];
+    std::uniform_int_distribution<size_t> szdistrib(1, args.block_size);
+
+    io61_file* inf = io61_open_check(args.input_file, O_RDONLY);
+    io61_file* outf = io61_open_check(args.output_file,
+                                      O_WRONLY | O_CREAT | O_TRUNC);
+
+    // Copy file data
+    while (true) {
+        struct iovec iov[nbufs];
+        for (int i = 0; i != nbufs; ++i) {
+            iov[i].iov_base = buf + i * args.block_size;
+            iov[i].iov_len = szdistrib(args.engine);
+        }
+
+        ssize_t nr = io61_readv(inf, iov, nbufs);
+        if (nr <= 0) {
+            break;
+        }
+
+        // trim the buffers to the data read
+        int n = 0;
+        for (size_t left = nr; left != 0; ++n) {
+            iov[n].iov_len = std::min(iov[n].iov_len, left);
+            left -= iov[n].iov_len;
+        }
+
+        ssize_t nw = io61_writev(outf, iov, n);
+        assert(nw == nr);
+
+        args.after_write(outf);
+    }
+
+    io61_close(inf);
+    io61_close(outf);
+    delete[] buf;
+}
@@ -1,23 +1,142 @@
 #include "io61.hh"
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/eventfd.h>
+#include <poll.h>
 #include <climits>
 #include <cerrno>
+#include <csignal>
+#include <ctime>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 // io61.cc
 #define BLOCK_SIZE 16384 //bigger cache size - optimization
+#define IO61_CACHE_BLOCKS 16 // default number of read cache slots
+#define IO61_MAP_WINDOW (1 << 30) // bytes of a regular file mapped at once
+#define IO61_READAHEAD_AFTER 4 // starved sequential reads before read-ahead starts
+#define IO61_READAHEAD_SLOW 50000 // nanoseconds a slow read waits, at least
+#define IO61_READAHEAD_SIZE (256 << 10) // bytes per read-ahead buffer
+
+
+// io61_slot
+//    One block of a read cache. A slot holds `len` bytes of the file
+//    starting at offset `tag`; `len == 0` means the slot is empty.
+
+struct io61_slot {
+    off_t tag = 0;                      // file offset of `buf[0]`
+    size_t len = 0;                     // number of valid bytes in `buf`
+    bool referenced = false;            // used since the clock hand passed
+    unsigned char buf[BLOCK_SIZE];
+};
+
+
+// io61_rabuf
+//    A read-ahead buffer, holding `len` bytes of the file at offset `tag`.
+//    Buffers are larger than cache blocks so that handing one between
+//    threads costs little next to filling it.
+
+struct io61_rabuf {
+    off_t tag = 0;
+    size_t len = 0;
+    int err = 0;                        // `errno` of a failed read
+    unsigned char buf[IO61_READAHEAD_SIZE];
+};
+
+
+// io61_readahead
+//    State shared with a read-ahead thread. The thread fills `bufs[fill]`
+//    with the data at file offset `next` whenever fewer than two buffers
+//    are full; the reader takes full buffers in the same order. A buffer
+//    with `len == 0` marks end of file (`err == 0`) or an error, after
+//    which the thread exits.
+
+struct io61_readahead {
+    std::thread thread;
+    std::mutex m;
+    std::condition_variable cv;
+    io61_rabuf bufs[2];
+    int nfull = 0;                      // full buffers, counting the reader's
+    int fill = 0;                       // buffer the thread fills next
+    int use = 0;                        // buffer the reader takes next
+    bool held = false;                  // true if the reader holds `bufs[use]`
+    off_t next;                         // file offset the thread reads next
+    bool stop = false;
+    int wakefd = -1;                    // eventfd that interrupts `poll`
+};
+
 
 // io61_file
 //    Data structure for io61 file wrappers. Add your own stuff.
+//
+//    Reads are served from the "view", the bytes of the file at offsets
+//    [`view_tag`, `view_tag + view_len`), which lives either in a slot
+//    of the read cache or in a memory-mapped window of the file.
+//
+//    Regular read-only files are mapped IO61_MAP_WINDOW bytes at a time,
+//    so reads and seeks need no system calls and no copy into a cache.
+//    Seeks more than BLOCK_SIZE bytes away mark the access pattern as
+//    random, other seeks as sequential. Sequential files get
+//    MADV_SEQUENTIAL, so the kernel reads far ahead; random ones get
+//    MADV_NORMAL, which reads around each fault. (MADV_RANDOM, which
+//    reads only the faulting page, made reordercat61 twice as slow on
+//    an uncached file.) Setting the IO61_MMAP environment variable to 0
+//    turns mapping off.
+//
+//    Other read-only files, and regular files that cannot be mapped,
+//    cache up to `nslots` blocks, keyed by their BLOCK_SIZE-aligned file
+//    offset, so seeking back to recently read data costs no system call.
+//    Replacement uses the CLOCK algorithm, an approximation of LRU. The
+//    number of slots is IO61_CACHE_BLOCKS, or the value of the
+//    IO61_CACHE_BLOCKS environment variable if set. Files that cannot
+//    seek, such as pipes, use one slot as a plain read buffer.
+//
+//    An unmapped file whose reads go in order but keep waiting for data
+//    (IO61_READAHEAD_AFTER reads in a row, with no seek, that took
+//    IO61_READAHEAD_SLOW ns or more or returned less than a block) gets
+//    a read-ahead thread, which reads the next chunk
+//    of the file while the caller works through the current one. A seek
+//    stops it. Files whose reads return at once, like regular files in
+//    the page cache, don't get one: handing buffers between threads
+//    costs more than such reads. IO61_READAHEAD=1 starts read-ahead at
+//    the first read, and IO61_READAHEAD=0 turns it off.
+//
+//    Write-only files buffer output in `cache`.
 
 struct io61_file {
     int fd = -1;     // file descriptor
     int mode;        // open mode (O_RDONLY or O_WRONLY)
-    unsigned char cache [BLOCK_SIZE];    //cache 
-    int cache_end;
-    int cache_offset;
-    int cache_start ;
 
+    // reading
+    const unsigned char* view = nullptr;  // data at file offset `view_tag`
+    off_t view_tag = 0;
+    size_t view_len = 0;
+    off_t pos = 0;                      // file position
+    bool seekable = false;              // true if `fd` supports `pread`
+
+    // read cache
+    io61_slot* slots = nullptr;         // allocated on first use
+    size_t nslots = 0;
+    size_t hand = 0;                    // CLOCK hand: next victim candidate
+
+    // read-ahead
+    io61_readahead* ra = nullptr;       // non-null while the thread runs
+    int readahead_after = IO61_READAHEAD_AFTER; // 0 means never
+    int sequential = 0;                 // starved reads in a row, in order
+
+    // mapped reading
+    bool mapped = false;                // true if reads use `map`
+    unsigned char* map = nullptr;       // mapped window, or nullptr
+    size_t map_len = 0;
+    int advice = MADV_SEQUENTIAL;       // current `madvise` hint
+    int pattern = 0;                    // > 0 sequential, < 0 random
+
+    // writing
+    unsigned char cache [BLOCK_SIZE];    //cache 
+    int cache_end = 0;
 };
 
 
@@ -31,6 +150,27 @@ io61_file* io61_fdopen(int fd, int mode) {
     io61_file* f = new io61_file;
     f->fd = fd;
     f->mode = mode;
+    if (mode == O_RDONLY) {
+        off_t pos = lseek(fd, 0, SEEK_CUR);
+        f->seekable = pos >= 0;
+        f->pos = f->seekable ? pos : 0;
+        f->nslots = 1;
+        if (const char* ra_env = getenv("IO61_READAHEAD")) {
+            f->readahead_after = strcmp(ra_env, "0") == 0 ? 0 : 1;
+        }
+        if (f->seekable) {
+            const char* env = getenv("IO61_CACHE_BLOCKS");
+            long n = env ? strtol(env, nullptr, 0) : IO61_CACHE_BLOCKS;
+            f->nslots = n > 0 ? n : 1;
+
+            // map regular files, but not empty ones: files like those in
+            // /proc claim size 0 and have data anyway
+            struct stat s;
+            const char* mmap_env = getenv("IO61_MMAP");
+            f->mapped = (!mmap_env || strcmp(mmap_env, "0") != 0)
+                && fstat(fd, &s) >= 0 && S_ISREG(s.st_mode) && s.st_size > 0;
+        }
+    }
     return f;
 }
 
@@ -38,19 +178,36 @@ io61_file* io61_fdopen(int fd, int mode) {
 // io61_close(f)
 //    Closes the io61_file `f` and releases all its resources.
 
+static void io61_readahead_stop(io61_file* f);
+
 int io61_close(io61_file* f) {
     io61_flush(f);
+    if (f->ra) {
+        io61_readahead_stop(f);
+    }
     int r = close(f->fd);
+    if (f->map) {
+        munmap(f->map, f->map_len);
+    }
+    delete[] f->slots;
     delete f;
     return r;
 }
 
 
+int io61_fill(io61_file* f);
+static ssize_t io61_read_direct(io61_file* f, unsigned char* buf, size_t sz, off_t off);
+static io61_slot* io61_victim(io61_file* f);
+static void io61_set_view(io61_file* f, io61_slot* s, off_t tag, size_t len);
+
 // io61_readc(f)
 //    Reads a single (unsigned) byte from `f` and returns it. Returns EOF,
 //    which equals -1, on end of file or error.
 
 int io61_readc(io61_file* f) {
+    if (size_t(f->pos - f->view_tag) < f->view_len) {
+        return f->view[f->pos++ - f->view_tag];
+    }
     unsigned char ch;
     ssize_t result = io61_read(f, &ch, 1);
     return (result == 1) ? ch : EOF;
@@ -60,54 +217,465 @@ size_t min(size_t a, size_t b) {
     return a < b ? a : b;
 }
 
-int io61_fill(io61_file* f);
+
+// io61_read(f, buf, sz)
+//    Reads up to `sz` bytes from `f` into `buf`. Returns the number of
+//    bytes read on success. Returns 0 if end-of-file is encountered before
+//    any bytes are read, and -1 if an error is encountered before any
+//    bytes are read.
+//
+//    Whole blocks that are not in the view are read straight into `buf`,
+//    skipping the cache, unless the file is mapped.
 
 ssize_t io61_read(io61_file* f, unsigned char* buf, size_t sz) {
     size_t nread = 0;
+    int r = 1;
 
     while (nread != sz) {
-        //check the cache to see if it is empty or already read fully, if so then refill it
-        if (f -> cache_offset == f -> cache_end){
-            if (io61_fill(f) <= 0) {
+        //if the view doesn't hold the file position, find or fill one that does
+        if (size_t(f->pos - f->view_tag) >= f->view_len) {
+            size_t direct = (sz - nread) - (sz - nread) % BLOCK_SIZE;
+            if (direct != 0 && !f->mapped && !f->ra
+                && (!f->seekable || f->pos % BLOCK_SIZE == 0)) {
+                ssize_t nr = io61_read_direct(f, buf + nread, direct, f->pos);
+                if (nr <= 0) {
+                    r = nr;
+                    break;
+                }
+                f->pos += nr;
+                nread += nr;
+                continue;
+            }
+            r = io61_fill(f);
+            if (r <= 0) {
                 break;
             }
         }
-        
-        // copy from cache to buf
-        size_t to_copy = min(f -> cache_end - f -> cache_offset, sz - nread);
 
-        memcpy(buf + nread, &f -> cache[f -> cache_offset], to_copy);
+        // copy from the view to buf
+        size_t off = f->pos - f->view_tag;
+        size_t to_copy = min(f->view_len - off, sz - nread);
+
+        memcpy(buf + nread, &f->view[off], to_copy);
 
-        f -> cache_offset += to_copy;
+        f->pos += to_copy;
         nread += to_copy;
 
     }
 
+    if (nread == 0 && r < 0) {
+        return -1;
+    }
     return nread;
- 
+
 }
 
-int io61_fill(io61_file* f){
-    ssize_t nr = read(f->fd, f -> cache, BLOCK_SIZE);
-    if (nr == 0) {
+
+// io61_readv(f, iov, iovcnt)
+//    Reads into the `iovcnt` buffers described by `iov`, in order. Returns
+//    like `io61_read` on a buffer as long as all of them together.
+//
+//    Data in the view is copied. When it runs out and at least BLOCK_SIZE
+//    bytes are still wanted, one `readv` (or `preadv`) fills the buffers
+//    directly; on files that cannot seek, that call also refills a cache
+//    slot with whatever follows. Mapped files are always copied from the
+//    mapping.
+
+ssize_t io61_readv(io61_file* f, const struct iovec* iov, int iovcnt) {
+    size_t nread = 0;
+    int r = 1;
+    int i = 0;          // current buffer
+    size_t off = 0;     // bytes filled in `iov[i]`
+
+    while (i != iovcnt) {
+        if (off == iov[i].iov_len) {
+            ++i;
+            off = 0;
+            continue;
+        }
+        unsigned char* buf = static_cast<unsigned char*>(iov[i].iov_base);
+
+        //if the view doesn't hold the file position, read directly or fill it
+        if (size_t(f->pos - f->view_tag) >= f->view_len) {
+            struct iovec v[IOV_MAX];
+            int n = 0;
+            size_t wanted = 0;
+            if (!f->mapped && !f->ra) {
+                v[n++] = {buf + off, iov[i].iov_len - off};
+                wanted = iov[i].iov_len - off;
+                for (int j = i + 1; j != iovcnt && n != IOV_MAX - 1; ++j) {
+                    v[n++] = iov[j];
+                    wanted += iov[j].iov_len;
+                }
+            }
+            if (wanted < BLOCK_SIZE) {
+                r = io61_fill(f);
+                if (r <= 0) {
+                    break;
+                }
+                continue;
+            }
+
+            io61_slot* s = nullptr;
+            if (!f->seekable) {
+                s = io61_victim(f);
+                v[n++] = {s->buf, BLOCK_SIZE};
+            }
+            ssize_t nr;
+            do {
+                if (f->seekable) {
+                    nr = preadv(f->fd, v, n, f->pos);
+                } else {
+                    nr = readv(f->fd, v, n);
+                }
+            } while (nr < 0 && (errno == EINTR || errno == EAGAIN));
+            if (nr <= 0) {
+                r = nr;
+                break;
+            }
+
+            // advance through the buffers; extra bytes landed in `s`
+            size_t nuser = min(nr, wanted);
+            f->pos += nuser;
+            nread += nuser;
+            while (nuser != 0) {
+                size_t chunk = min(iov[i].iov_len - off, nuser);
+                off += chunk;
+                nuser -= chunk;
+                if (off == iov[i].iov_len && nuser != 0) {
+                    ++i;
+                    off = 0;
+                }
+            }
+            if (s && size_t(nr) > wanted) {
+                io61_set_view(f, s, f->pos, nr - wanted);
+            }
+            continue;
+        }
+
+        // copy from the view to the buffer
+        size_t voff = f->pos - f->view_tag;
+        size_t to_copy = min(f->view_len - voff, iov[i].iov_len - off);
+        memcpy(buf + off, &f->view[voff], to_copy);
+        f->pos += to_copy;
+        off += to_copy;
+        nread += to_copy;
+    }
+
+    if (nread == 0 && r < 0) {
+        return -1;
+    }
+    return nread;
+}
+
+
+// io61_map(f)
+//    Maps the window of `f` that holds `f->pos` and makes it the view.
+//    Returns 1 on success, 0 at end of file, and -1 on error. If the file
+//    cannot be mapped, turns `f->mapped` off and returns -1.
+
+static int io61_map(io61_file* f) {
+    if (f->map) {
+        munmap(f->map, f->map_len);
+        f->map = nullptr;
+        f->view_len = 0;
+    }
+    struct stat s;
+    if (fstat(f->fd, &s) < 0) {
+        return -1;
+    }
+    if (f->pos >= s.st_size) {
         return 0;
-    } else if (nr < 0) {
+    }
+
+    off_t tag = f->pos - f->pos % IO61_MAP_WINDOW;
+    size_t len = min(IO61_MAP_WINDOW, s.st_size - tag);
+    void* p = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, f->fd, tag);
+    if (p == MAP_FAILED) {
+        f->mapped = false;
         return -1;
     }
-    f -> cache_end = nr;
-    f -> cache_offset = 0;     //reset offset
+    madvise(p, len, f->advice);
+    f->map = static_cast<unsigned char*>(p);
+    f->map_len = len;
+    f->view = f->map;
+    f->view_tag = tag;
+    f->view_len = len;
+    return 1;
+}
 
-    return nr;
+
+// io61_fill(f)
+//    Makes the view hold the byte at `f->pos`, mapping it or reading it
+//    from the file unless a slot already holds it. Returns 1 on success,
+//    0 at end of file, and -1 on error.
+
+static int io61_readahead_next(io61_file* f);
+static void io61_readahead_start(io61_file* f);
+
+int io61_fill(io61_file* f){
+    if (f->mapped) {
+        int r = io61_map(f);
+        if (f->mapped) {
+            return r;
+        }
+    }
+    if (f->ra) {
+        int r = io61_readahead_next(f);
+        if (r <= 0 || size_t(f->pos - f->view_tag) < f->view_len) {
+            return r;
+        }
+        io61_readahead_stop(f);
+    }
+    off_t tag = f->pos;
+    io61_slot* s = nullptr;
+    if (f->seekable) {
+        tag -= tag % BLOCK_SIZE;
+        for (size_t i = 0; f->slots && i != f->nslots; ++i) {
+            if (f->slots[i].tag == tag && f->slots[i].len != 0) {
+                s = &f->slots[i];
+                break;
+            }
+        }
+        if (s && size_t(f->pos - tag) < s->len) {
+            io61_set_view(f, s, tag, s->len);
+            return 1;
+        }
+    }
+
+    // miss: refetch a short block in place (the file may have grown)
+    if (!s) {
+        s = io61_victim(f);
+    }
+
+    timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    ssize_t nr = io61_read_direct(f, s->buf, BLOCK_SIZE, tag);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    io61_set_view(f, s, tag, nr > 0 ? nr : 0);
+    if (nr < 0) {
+        return -1;
+    }
+
+    // start reading ahead once enough reads in a row had to wait, or
+    // found less than a block waiting for them
+    long ns = (t1.tv_sec - t0.tv_sec) * 1000000000L + t1.tv_nsec - t0.tv_nsec;
+    bool starved = ns >= IO61_READAHEAD_SLOW || (nr > 0 && nr < BLOCK_SIZE);
+    if (!starved && f->readahead_after != 1) {
+        f->sequential = 0;
+    } else if (f->readahead_after != 0
+               && ++f->sequential >= f->readahead_after
+               && (f->seekable ? s->len == BLOCK_SIZE : s->len != 0)) {
+        io61_readahead_start(f);
+    }
+    return size_t(f->pos - tag) < s->len ? 1 : 0;
 
 }    
 
 
+// io61_victim(f)
+//    Returns the slot of `f` to refill next, skipping slots referenced
+//    since the clock hand passed them.
+
+static io61_slot* io61_victim(io61_file* f) {
+    if (!f->slots) {
+        f->slots = new io61_slot[f->nslots];
+    }
+    while (true) {
+        io61_slot* s = &f->slots[f->hand];
+        f->hand = (f->hand + 1) % f->nslots;
+        if (!s->referenced) {
+            return s;
+        }
+        s->referenced = false;
+    }
+}
+
+
+// io61_set_view(f, s, tag, len)
+//    Records that slot `s` holds `len` bytes at file offset `tag`, and
+//    makes it the view.
+
+static void io61_set_view(io61_file* f, io61_slot* s, off_t tag, size_t len) {
+    s->tag = tag;
+    s->len = len;
+    s->referenced = true;
+    f->view = s->buf;
+    f->view_tag = tag;
+    f->view_len = len;
+}
+
+
+// io61_read_direct(f, buf, sz, off)
+//    Reads up to `sz` bytes at file offset `off` into `buf` with one
+//    system call, bypassing the view. Files that cannot seek read at
+//    their current offset, which is `off`. Returns the result of the call.
+
+static ssize_t io61_read_direct(io61_file* f, unsigned char* buf, size_t sz, off_t off) {
+    ssize_t nr;
+    do {
+        if (f->seekable) {
+            nr = pread(f->fd, buf, sz, off);
+        } else {
+            nr = read(f->fd, buf, sz);
+        }
+    } while (nr < 0 && (errno == EINTR || errno == EAGAIN));
+    return nr;
+}
+
+
+// io61_readahead_run(ra, fd, seekable)
+//    Body of a read-ahead thread for file descriptor `fd`.
+
+static void io61_readahead_run(io61_readahead* ra, int fd, bool seekable) {
+    std::unique_lock<std::mutex> guard(ra->m);
+    while (true) {
+        ra->cv.wait(guard, [&] () { return ra->stop || ra->nfull < 2; });
+        if (ra->stop) {
+            return;
+        }
+        io61_rabuf* b = &ra->bufs[ra->fill];
+        off_t off = ra->next;
+        guard.unlock();
+
+        ssize_t nr;
+        do {
+            if (seekable) {
+                nr = pread(fd, b->buf, IO61_READAHEAD_SIZE, off);
+            } else {
+                // wait for data or for `io61_readahead_stop`
+                struct pollfd pfd[2] = {{fd, POLLIN, 0}, {ra->wakefd, POLLIN, 0}};
+                if (poll(pfd, 2, -1) > 0 && pfd[1].revents) {
+                    return;
+                }
+                nr = read(fd, b->buf, IO61_READAHEAD_SIZE);
+            }
+        } while (nr < 0 && (errno == EINTR || errno == EAGAIN));
+
+        guard.lock();
+        b->tag = off;
+        b->len = nr > 0 ? nr : 0;
+        b->err = nr < 0 ? errno : 0;
+        ra->next += b->len;
+        ra->fill = 1 - ra->fill;
+        ++ra->nfull;
+        ra->cv.notify_all();
+        if (nr <= 0) {
+            return;
+        }
+    }
+}
+
+
+// io61_readahead_start(f)
+//    Starts a read-ahead thread for `f`, reading from the end of the view.
+
+static void io61_readahead_start(io61_file* f) {
+    io61_readahead* ra = new io61_readahead;
+    ra->next = f->view_tag + f->view_len;
+    ra->wakefd = eventfd(0, EFD_CLOEXEC);
+    if (ra->wakefd < 0) {
+        delete ra;
+        f->readahead_after = 0;
+        return;
+    }
+    // signals are for the caller's thread, not this one
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    ra->thread = std::thread(io61_readahead_run, ra, f->fd, f->seekable);
+    pthread_sigmask(SIG_SETMASK, &old, nullptr);
+    f->ra = ra;
+}
+
+
+// io61_readahead_stop(f)
+//    Stops the read-ahead thread for `f` and drops the data it read.
+
+static void io61_readahead_stop(io61_file* f) {
+    io61_readahead* ra = f->ra;
+    {
+        std::unique_lock<std::mutex> guard(ra->m);
+        ra->stop = true;
+        ra->cv.notify_all();
+    }
+    uint64_t one = 1;
+    ssize_t r = write(ra->wakefd, &one, sizeof(one));
+    (void) r;
+    ra->thread.join();
+    close(ra->wakefd);
+    if (f->view == ra->bufs[0].buf || f->view == ra->bufs[1].buf) {
+        f->view_len = 0;
+    }
+    delete ra;
+    f->ra = nullptr;
+    f->sequential = 0;
+}
+
+
+// io61_readahead_next(f)
+//    Hands the reader's buffer back to the read-ahead thread and makes the
+//    next full buffer the view, waiting for it if necessary. Returns 1 on
+//    success, 0 at end of file, and -1 on error.
+
+static int io61_readahead_next(io61_file* f) {
+    io61_readahead* ra = f->ra;
+    std::unique_lock<std::mutex> guard(ra->m);
+    if (ra->held && ra->bufs[ra->use].len != 0) {
+        ra->held = false;
+        --ra->nfull;
+        ra->use = 1 - ra->use;
+        ra->cv.notify_all();
+    }
+    ra->cv.wait(guard, [&] () { return ra->nfull > 0; });
+    ra->held = true;
+
+    io61_rabuf* b = &ra->bufs[ra->use];
+    f->view = b->buf;
+    f->view_tag = b->tag;
+    f->view_len = b->len;
+    if (b->len == 0) {
+        errno = b->err;
+        return errno != 0 ? -1 : 0;
+    }
+    return 1;
+}
+
+
+// io61_seek(f, off)
+//    Changes the file pointer for file `f` to `off` bytes into the file.
+//    Returns 0 on success and -1 on failure. Read-only files just move
+//    their position; the data is found or fetched by the next read.
+
 int io61_seek(io61_file* f, off_t off) {
-    if (off >= f->cache_start && off < f->cache_start + f->cache_end) {
-        f->cache_offset = off - f->cache_start; //adjust offset
+    if (f->mode == O_RDONLY) {
+        if (!f->seekable || off < 0) {
+            return -1;
+        }
+        if (off != f->pos) {
+            if (f->ra) {
+                io61_readahead_stop(f);
+            }
+            f->sequential = 0;
+        }
+        if (f->mapped) {
+            // track the access pattern and tell the kernel when it changes
+            bool far = off > f->pos + BLOCK_SIZE || off < f->pos - BLOCK_SIZE;
+            f->pattern += far ? -1 : 1;
+            f->pattern = f->pattern < -8 ? -8 : (f->pattern > 8 ? 8 : f->pattern);
+            int advice = f->pattern < 0 ? MADV_NORMAL : MADV_SEQUENTIAL;
+            if (advice != f->advice) {
+                f->advice = advice;
+                if (f->map) {
+                    madvise(f->map, f->map_len, advice);
+                }
+            }
+        }
+        f->pos = off;
         return 0;
     }
-    
+
     if (f->mode == O_WRONLY) {
         if (io61_flush(f) < 0) {
             return -1;
@@ -117,21 +685,6 @@ int io61_seek(io61_file* f, off_t off) {
             return -1;
         }  
 
-        f->cache_start = off;
-        f->cache_offset = 0;
-        f->cache_end = 0;
-        return 0;
-    }
-
-    if (f->mode == O_RDONLY) {
-        
-        f -> cache_start = (off / BLOCK_SIZE) * BLOCK_SIZE;
-        off_t r = lseek(f->fd, f -> cache_start, SEEK_SET);
-
-        if (r == -1 || io61_fill(f) < 0) {
-            return -1;
-        }
-        f -> cache_offset = off - f->cache_start;
         return 0;
     }
     return -1;
@@ -151,12 +704,71 @@ int io61_writec(io61_file* f, int c) {
 }
 
 
+// io61_write_all(fd, buf, sz)
+//    Writes all `sz` bytes of `buf` to `fd`, retrying short writes.
+//    Returns the number of bytes written, which is less than `sz` only
+//    if an error occurred.
+
+static size_t io61_write_all(int fd, const unsigned char* buf, size_t sz) {
+    size_t nwritten = 0;
+    while (nwritten < sz) {
+        ssize_t nw;
+        do {
+            nw = write(fd, buf + nwritten, sz - nwritten);
+        } while (nw < 0 && (errno == EINTR || errno == EAGAIN));
+
+        if (nw < 0) {
+            break;
+        }
+        nwritten += nw;
+    }
+    return nwritten;
+}
+
+
+// io61_writev_all(fd, iov, iovcnt)
+//    Writes all the buffers described by `iov` to `fd`, retrying short
+//    writes. May modify `iov`. Returns the number of bytes written, which
+//    is less than the total only if an error occurred.
+
+static size_t io61_writev_all(int fd, struct iovec* iov, int iovcnt) {
+    size_t nwritten = 0;
+    while (iovcnt != 0) {
+        ssize_t nw;
+        do {
+            nw = writev(fd, iov, iovcnt);
+        } while (nw < 0 && (errno == EINTR || errno == EAGAIN));
+
+        if (nw < 0) {
+            break;
+        }
+        nwritten += nw;
+
+        // skip the buffers written
+        size_t left = nw;
+        while (iovcnt != 0 && left >= iov->iov_len) {
+            left -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if (iovcnt != 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + left;
+            iov->iov_len -= left;
+        }
+    }
+    return nwritten;
+}
+
+
 // io61_write(f, buf, sz)
 //    Writes `sz` characters from `buf` to `f`. Returns `sz` on success.
 //    Can write fewer than `sz` characters when there is an error, such as
 //    a drive running out of space. In this case io61_write returns the
 //    number of characters written, or -1 if no characters were written
 //    before the error occurred.
+//
+//    Once the cache is empty, whole blocks are written straight from
+//    `buf`, skipping the cache.
 
 ssize_t io61_write(io61_file* f, const unsigned char* buf, size_t sz) {
     size_t nwritten = 0;
@@ -168,6 +780,17 @@ ssize_t io61_write(io61_file* f, const unsigned char* buf, size_t sz) {
                 return -1;
             }
         }
+
+        // large writes go straight to the file
+        size_t direct = (sz - nwritten) - (sz - nwritten) % BLOCK_SIZE;
+        if (f->cache_end == 0 && direct != 0) {
+            size_t nw = io61_write_all(f->fd, buf + nwritten, direct);
+            nwritten += nw;
+            if (nw != direct) {
+                return nwritten != 0 ? ssize_t(nwritten) : -1;
+            }
+            continue;
+        }
         
         // if cache not full, copy from buf to cache
         size_t to_copy = min(BLOCK_SIZE - f -> cache_end, sz - nwritten);
@@ -182,6 +805,58 @@ ssize_t io61_write(io61_file* f, const unsigned char* buf, size_t sz) {
 }
 
 
+// io61_writev(f, iov, iovcnt)
+//    Writes the `iovcnt` buffers described by `iov` to `f`, in order.
+//    Returns like `io61_write` on a buffer as long as all of them together.
+//
+//    Buffers that fit in the cache are copied there. Otherwise the cached
+//    data and the buffers go out together with one `writev`, so nothing
+//    is copied and a batch of small buffers costs one system call.
+
+ssize_t io61_writev(io61_file* f, const struct iovec* iov, int iovcnt) {
+    size_t total = 0;
+    for (int i = 0; i != iovcnt; ++i) {
+        total += iov[i].iov_len;
+    }
+    if (f->cache_end + total <= BLOCK_SIZE) {
+        for (int i = 0; i != iovcnt; ++i) {
+            memcpy(&f->cache[f->cache_end], iov[i].iov_base, iov[i].iov_len);
+            f->cache_end += iov[i].iov_len;
+        }
+        return total;
+    }
+
+    size_t nwritten = 0;
+    int i = 0;
+    while (i != iovcnt) {
+        // the cache, then as many buffers as fit in one call
+        struct iovec v[IOV_MAX];
+        int n = 0;
+        size_t cached = f->cache_end, batch = 0;
+        if (cached != 0) {
+            v[n++] = {f->cache, cached};
+        }
+        for (; i != iovcnt && n != IOV_MAX; ++i) {
+            v[n++] = iov[i];
+            batch += iov[i].iov_len;
+        }
+
+        size_t nw = io61_writev_all(f->fd, v, n);
+        if (nw < cached) {
+            memmove(f->cache, f->cache + nw, cached - nw);
+            f->cache_end -= nw;
+            return nwritten != 0 ? ssize_t(nwritten) : -1;
+        }
+        f->cache_end = 0;
+        nwritten += nw - cached;
+        if (nw != cached + batch) {
+            return nwritten != 0 ? ssize_t(nwritten) : -1;
+        }
+    }
+    return nwritten;
+}
+
+
 // io61_flush(f)
 //    If `f` was opened write-only, `io61_flush(f)` forces a write of any
 //    cached data written to `f`. Returns 0 on success; returns -1 if an error
@@ -192,17 +867,8 @@ ssize_t io61_write(io61_file* f, const unsigned char* buf, size_t sz) {
 
 int io61_flush(io61_file* f) {
     if (f->mode == O_WRONLY && f->cache_end > 0) {
-        size_t nwritten = 0;
-        while ((int)nwritten < f->cache_end) {
-            ssize_t nw;
-            do {
-                nw = write(f->fd, f->cache + nwritten, f->cache_end - nwritten);
-            } while (nw < 0 && (errno == EINTR || errno == EAGAIN));
-
-            if (nw < 0) {
-                return -1; 
-            }
-            nwritten += nw;
+        if (io61_write_all(f->fd, f->cache, f->cache_end) != size_t(f->cache_end)) {
+            return -1;
         }
         f->cache_end = 0;
     }
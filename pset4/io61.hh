@@ -9,6 +9,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sched.h>
+#include <sys/uio.h>
 
 struct io61_file;
 
@@ -27,6 +28,9 @@ int io61_writec(io61_file* f, int c);
 ssize_t io61_read(io61_file* f, unsigned char* buf, size_t sz);
 ssize_t io61_write(io61_file* f, const unsigned char* buf, size_t sz);
 
+ssize_t io61_readv(io61_file* f, const struct iovec* iov, int iovcnt);
+ssize_t io61_writev(io61_file* f, const struct iovec* iov, int iovcnt);
+
 int io61_flush(io61_file* f);
 
 int fd_open_check(const char* filename, int mode);
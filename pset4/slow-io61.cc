@@ -89,6 +89,26 @@ ssize_t io61_read(io61_file* f, unsigned char* buf, size_t sz) {
 }
 
 
+// io61_readv(f, iov, iovcnt)
+//    Reads into the `iovcnt` buffers described by `iov`, in order. Returns
+//    like `io61_read` on a buffer as long as all of them together.
+
+ssize_t io61_readv(io61_file* f, const struct iovec* iov, int iovcnt) {
+    size_t nread = 0;
+    for (int i = 0; i != iovcnt; ++i) {
+        ssize_t nr = io61_read(f, (unsigned char*) iov[i].iov_base, iov[i].iov_len);
+        if (nr < 0) {
+            return nread != 0 ? (ssize_t) nread : -1;
+        }
+        nread += nr;
+        if ((size_t) nr != iov[i].iov_len) {
+            break;
+        }
+    }
+    return nread;
+}
+
+
 // io61_writec(f)
 //    Write a single character `c` to `f` (converted to unsigned char).
 //    Returns 0 on success and -1 on error.
@@ -127,6 +147,26 @@ ssize_t io61_write(io61_file* f, const unsigned char* buf, size_t sz) {
 }
 
 
+// io61_writev(f, iov, iovcnt)
+//    Writes the `iovcnt` buffers described by `iov` to `f`, in order.
+//    Returns like `io61_write` on a buffer as long as all of them together.
+
+ssize_t io61_writev(io61_file* f, const struct iovec* iov, int iovcnt) {
+    size_t nwritten = 0;
+    for (int i = 0; i != iovcnt; ++i) {
+        ssize_t nw = io61_write(f, (const unsigned char*) iov[i].iov_base, iov[i].iov_len);
+        if (nw < 0) {
+            return nwritten != 0 ? (ssize_t) nwritten : -1;
+        }
+        nwritten += nw;
+        if ((size_t) nw != iov[i].iov_len) {
+            break;
+        }
+    }
+    return nwritten;
+}
+
+
 // io61_flush(f)
 //    If `f` was opened write-only, `io61_flush(f)` forces a write of any
 //    cached data written to `f`. Returns 0 on success; returns -1 if an error
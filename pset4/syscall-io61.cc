@@ -76,6 +76,15 @@ ssize_t io61_read(io61_file* f, unsigned char* buf, size_t sz) {
 }
 
 
+// io61_readv(f, iov, iovcnt)
+//    Reads into the `iovcnt` buffers described by `iov`, in order. Returns
+//    like `io61_read` on a buffer as long as all of them together.
+
+ssize_t io61_readv(io61_file* f, const struct iovec* iov, int iovcnt) {
+    return readv(f->fd, iov, iovcnt);
+}
+
+
 // io61_writec(f)
 //    Write a single character `c` to `f` (converted to unsigned char).
 //    Returns 0 on success and -1 on error.
@@ -103,6 +112,15 @@ ssize_t io61_write(io61_file* f, const unsigned char* buf, size_t sz) {
 }
 
 
+// io61_writev(f, iov, iovcnt)
+//    Writes the `iovcnt` buffers described by `iov` to `f`, in order.
+//    Returns like `io61_write` on a buffer as long as all of them together.
+
+ssize_t io61_writev(io61_file* f, const struct iovec* iov, int iovcnt) {
+    return writev(f->fd, iov, iovcnt);
+}
+
+
 // io61_flush(f)
 //    If `f` was opened write-only, `io61_flush(f)` forces a write of any
 //    cached data written to `f`. Returns 0 on success; returns -1 if an error